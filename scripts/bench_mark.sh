@@ -0,0 +1,43 @@
+#!/bin/bash
+# Mark time of the mark-sweep heap against TIGER_GC_THREADS, taken from the
+# "mark" phases of the GC trace of testdata/bench/mark_tree.tig.
+# usage: scripts/bench_mark.sh [thread counts, default 1 2 4 8]
+
+WORKDIR=$(dirname "$(dirname "$(readlink -f "$0")")")
+BENCH=${WORKDIR}/testdata/bench/mark_tree.tig
+
+threads_list=("$@")
+if [[ ${#threads_list[@]} == 0 ]]; then
+  threads_list=(1 2 4 8)
+fi
+
+cd "$WORKDIR" && mkdir -p build && cd build &&
+  cmake -DCMAKE_BUILD_TYPE=Release .. >/dev/null &&
+  make tiger-compiler -j >/dev/null
+if [[ $? != 0 ]]; then
+  echo "Error: Compile error, try to run make build and debug"
+  exit 1
+fi
+./tiger-compiler "$BENCH" &>/dev/null
+g++ -Wl,--wrap,getchar -m64 "$BENCH.s" \
+  "$WORKDIR"/src/tiger/runtime/runtime.cc \
+  "$WORKDIR"/src/tiger/runtime/gc/heap/*.cc -o mark_tree.out &>/dev/null
+if [ ! -s mark_tree.out ]; then
+  echo "Error: Link error [mark_tree]"
+  exit 1
+fi
+
+trace=$(mktemp)
+printf "%8s %6s %10s %10s\n" threads marks "total ms" "max ms"
+for threads in "${threads_list[@]}"; do
+  TIGER_HEAP=mark-sweep TIGER_GC_THREADS=$threads TIGER_GC_TRACE=$trace \
+    ./mark_tree.out >/dev/null
+  # one event per line, durations in microseconds
+  grep '"name":"mark"' "$trace" |
+    sed 's/.*"dur":\([0-9.]*\).*/\1/' |
+    awk -v threads="$threads" '
+      { n++; total += $1; if ($1 > max) max = $1 }
+      END { printf "%8d %6d %10.1f %10.1f\n", threads, n, total / 1e3,
+                   max / 1e3 }'
+done
+rm -f "$trace"
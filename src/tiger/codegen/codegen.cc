@@ -7,6 +7,21 @@ namespace {
 
 constexpr int maxlen = 1024;
 
+// Match the frame slot MEM(fp + offset) built by InFrameAccess::ToExp, which
+// is then addressed off the stack pointer directly. gc::Roots follows the
+// pointer slots through these accesses.
+bool FrameSlot(const tree::Exp *address, std::string *offset) {
+  const auto binop = dynamic_cast<const tree::BinopExp *>(address);
+  if (!binop || binop->op_ != tree::PLUS_OP)
+    return false;
+  const auto base = dynamic_cast<const tree::TempExp *>(binop->left_);
+  const auto k = dynamic_cast<const tree::ConstExp *>(binop->right_);
+  if (!base || !k || base->temp_ != reg_manager->FramePointer())
+    return false;
+  *offset = (k->consti_ < 0 ? "" : "+") + std::to_string(k->consti_);
+  return true;
+}
+
 } // namespace
 
 namespace cg {
@@ -110,7 +125,13 @@ void CjumpStm::Munch(assem::InstrList &instr_list, std::string_view fs) {
 
 void MoveStm::Munch(assem::InstrList &instr_list, std::string_view fs) {
   const auto src_tmp = src_->Munch(instr_list, fs);
-  if (typeid(*dst_) == typeid(tree::MemExp)) {
+  std::string offset;
+  if (typeid(*dst_) == typeid(tree::MemExp) &&
+      FrameSlot(dynamic_cast<tree::MemExp *>(dst_)->exp_, &offset)) {
+    instr_list.Append(new assem::OperInstr(
+        "movq `s0, " + std::string(fs) + offset + "(`s1)", nullptr,
+        new temp::TempList{src_tmp, reg_manager->StackPointer()}, nullptr));
+  } else if (typeid(*dst_) == typeid(tree::MemExp)) {
     const auto dst_exp_tmp =
         dynamic_cast<tree::MemExp *>(dst_)->exp_->Munch(instr_list, fs);
     instr_list.Append(new assem::OperInstr(
@@ -130,6 +151,19 @@ void ExpStm::Munch(assem::InstrList &instr_list, std::string_view fs) {
 
 temp::Temp *BinopExp::Munch(assem::InstrList &instr_list, std::string_view fs) {
   const auto ret_val = temp::TempFactory::NewTemp();
+  if ((op_ == LSHIFT_OP || op_ == RSHIFT_OP) &&
+      typeid(*right_) == typeid(tree::ConstExp)) {
+    // only shifts by a constant are generated, e.g. by the write barrier
+    const std::string shift = op_ == LSHIFT_OP ? "shlq" : "shrq";
+    const auto count = dynamic_cast<tree::ConstExp *>(right_)->consti_;
+    instr_list.Append(new assem::MoveInstr(
+        "movq `s0, `d0", new temp::TempList(ret_val),
+        new temp::TempList(left_->Munch(instr_list, fs))));
+    instr_list.Append(new assem::OperInstr(
+        shift + " $" + std::to_string(count) + ", `d0",
+        new temp::TempList(ret_val), new temp::TempList(ret_val), nullptr));
+    return ret_val;
+  }
   temp::Temp *left_tmp = left_->Munch(instr_list, fs);
   temp::Temp *right_tmp = right_->Munch(instr_list, fs);
   switch (this->op_) {
@@ -183,7 +217,13 @@ temp::Temp *BinopExp::Munch(assem::InstrList &instr_list, std::string_view fs) {
                              new temp::TempList(reg_manager->GetRegister(0))));
     return ret_val;
   case AND_OP:
-    break;
+    instr_list.Append(new assem::MoveInstr("movq `s0, `d0",
+                                           new temp::TempList(ret_val),
+                                           new temp::TempList(left_tmp)));
+    instr_list.Append(
+        new assem::OperInstr("andq `s0, `d0", new temp::TempList(ret_val),
+                             new temp::TempList{right_tmp, ret_val}, nullptr));
+    return ret_val;
   case OR_OP:
     break;
   case LSHIFT_OP:
@@ -200,8 +240,15 @@ temp::Temp *BinopExp::Munch(assem::InstrList &instr_list, std::string_view fs) {
 }
 
 temp::Temp *MemExp::Munch(assem::InstrList &instr_list, std::string_view fs) {
-  auto res = this->exp_->Munch(instr_list, fs);
   auto ret_val = temp::TempFactory::NewTemp();
+  if (std::string offset; FrameSlot(exp_, &offset)) {
+    instr_list.Append(new assem::OperInstr(
+        "movq " + std::string(fs) + offset + "(`s0), `d0",
+        new temp::TempList(ret_val),
+        new temp::TempList(reg_manager->StackPointer()), nullptr));
+    return ret_val;
+  }
+  auto res = this->exp_->Munch(instr_list, fs);
   instr_list.Append(new assem::OperInstr("movq (`s0), `d0",
                                          new temp::TempList(ret_val),
                                          new temp::TempList{res}, nullptr));
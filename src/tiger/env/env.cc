@@ -31,6 +31,8 @@ void ProgSem::FillBaseVEnv() {
 
   venv_->Enter(sym::Symbol::UniqueSymbol("getchar"),
                new env::FunEntry(new type::TyList(), result));
+  venv_->Enter(sym::Symbol::UniqueSymbol("readline"),
+               new env::FunEntry(new type::TyList(), result));
 
   formals = new type::TyList(type::StringTy::Instance());
 
@@ -99,6 +101,8 @@ void ProgTr::FillBaseVEnv() {
 
   venv_->Enter(sym::Symbol::UniqueSymbol("getchar"),
                new env::FunEntry(level, label, new type::TyList(), result));
+  venv_->Enter(sym::Symbol::UniqueSymbol("readline"),
+               new env::FunEntry(level, label, new type::TyList(), result));
 
   formals = new type::TyList(type::StringTy::Instance());
 
@@ -10,19 +10,26 @@ void ErrorMsg::Newline() {
   line_pos_.push_front(tok_pos_);
 }
 
-void ErrorMsg::Error(int pos, std::string_view message, ...) {
-  va_list ap;
+int ErrorMsg::Line(int pos, int *line_start) const {
   int num = line_num_;
-  int val = -1;
+  *line_start = -1;
 
-  // Backtrace to the error line number
-  any_errors_ = true;
+  // Backtrace to the line number
   for (auto i : line_pos_) {
-    val = i;
+    *line_start = i;
     if (i < pos)
       break;
     num--;
   }
+  return num;
+}
+
+void ErrorMsg::Error(int pos, std::string_view message, ...) {
+  va_list ap;
+  int val;
+  int num = Line(pos, &val);
+
+  any_errors_ = true;
 
   // Output error message
   if (!file_name_.empty())
@@ -35,4 +42,13 @@ void ErrorMsg::Error(int pos, std::string_view message, ...) {
   fprintf(stderr, "\n");
 }
 
+std::string ErrorMsg::Position(int pos) const {
+  int val;
+  int num = Line(pos, &val);
+  std::string position = file_name_;
+  if (val != -1)
+    position += ":" + std::to_string(num) + "." + std::to_string(pos - val);
+  return position;
+}
+
 } // namespace err
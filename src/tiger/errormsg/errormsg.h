@@ -34,6 +34,12 @@ public:
    */
   void Error(int pos, std::string_view message, ...);
 
+  /**
+   * Source position as file:line.column
+   * @param pos position of a token
+   */
+  [[nodiscard]] std::string Position(int pos) const;
+
   /**
    * Getter for `tok_pos_`
    */
@@ -45,6 +51,12 @@ public:
   [[nodiscard]] bool AnyErrors() const { return any_errors_; }
 
 private:
+  /**
+   * Line number of pos
+   * @param line_start set to the position the line starts at, -1 if unknown
+   */
+  int Line(int pos, int *line_start) const;
+
   int tok_pos_ = 1;         // current token position
   bool any_errors_ = false; // flag indicating if any error occurrs
   int line_num_ = 1;        // current line number
@@ -95,6 +95,8 @@ class InFrameAccess : public Access {
 public:
   int offset;
   bool in_heap = false;
+  // whether functions nested in this one may access the slot
+  bool escape = true;
   explicit InFrameAccess(const int offset, const bool in_heap = false)
       : offset(offset), in_heap(in_heap) {}
   tree::Exp *ToExp(tree::Exp *frame_ptr) const override {
@@ -120,6 +122,11 @@ public:
   virtual frame::Access *AllocLocal(bool escape, bool in_heap = false,
                                     Frame *frame = nullptr) = 0;
   virtual std::vector<int64_t> GetOffsets() const = 0;
+  /**
+   * The offsets of GetOffsets() that nested functions may read through the
+   * static link.
+   */
+  virtual std::vector<int64_t> GetEscapingOffsets() const = 0;
   [[nodiscard]] std::list<Access *> *Formals() const { return formals_; }
   [[nodiscard]] std::string GetLabel() const { return name_->Name(); }
 };
@@ -158,6 +165,27 @@ public:
                    Frag **pointer_frag) const override;
 };
 
+/**
+ * Pointer bitmap of a record type: the field count, then one bit per field
+ * (bit i of word i / 64) set for the fields holding heap pointers, then the
+ * type name as a C string for heap histograms.
+ */
+class DescriptorFrag : public Frag {
+public:
+  temp::Label *label_;
+  uint64_t field_num_;
+  std::vector<uint64_t> bitmap_;
+  std::string name_;
+
+  DescriptorFrag(temp::Label *label, uint64_t field_num,
+                 std::vector<uint64_t> bitmap, std::string name)
+      : label_(label), field_num_(field_num), bitmap_(std::move(bitmap)),
+        name_(std::move(name)) {}
+
+  void OutputAssem(FILE *out, OutputPhase phase, bool need_ra,
+                   Frag **pointer_frag) const override;
+};
+
 class ProcFrag : public Frag {
 public:
   tree::Stm *body_;
@@ -182,7 +210,10 @@ public:
   Frags() = default;
   void PushBack(Frag *frag) { frags_.emplace_back(frag); }
   const std::list<Frag *> &GetList() { return frags_; }
-  PointerMapFrag *UpdateNextLink();
+  /**
+   * Merge the pointer maps of all functions into the first fragment.
+   */
+  PointerMapFrag *MergePointerMaps();
 
 private:
   std::list<Frag *> frags_;
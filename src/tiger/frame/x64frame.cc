@@ -15,6 +15,7 @@ frame::Access *X64Frame::AllocLocal(const bool escape, const bool in_heap,
   if (!escape && in_heap) {
     assert(frame != nullptr);
     auto access = new InFrameAccess(AllocLocal(), true);
+    access->escape = false;
     frame->heap_accesses_->emplace_back(access);
     return access;
   }
@@ -36,11 +37,17 @@ int X64Frame::AllocLocal() {
   return offset_;
 }
 std::vector<int64_t> X64Frame::GetOffsets() const {
+  return PointerOffsets(false);
+}
+std::vector<int64_t> X64Frame::GetEscapingOffsets() const {
+  return PointerOffsets(true);
+}
+std::vector<int64_t> X64Frame::PointerOffsets(const bool escaping_only) const {
   std::vector<int64_t> ret;
   for (auto &access : *heap_accesses_) {
     if (typeid(*access) == typeid(InFrameAccess)) {
       if (const auto inf_acc = dynamic_cast<InFrameAccess *>(access);
-          inf_acc->in_heap) {
+          inf_acc->in_heap && (inf_acc->escape || !escaping_only)) {
         ret.emplace_back(inf_acc->offset);
       }
     }
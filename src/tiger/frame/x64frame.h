@@ -56,6 +56,10 @@ public:
                             Frame *frame = nullptr) override;
   int AllocLocal();
   std::vector<int64_t> GetOffsets() const override;
+  std::vector<int64_t> GetEscapingOffsets() const override;
+
+private:
+  std::vector<int64_t> PointerOffsets(bool escaping_only) const;
 };
 
 tree::Stm *ProcEntryExit1(frame::Frame *frame, tree::Stm *stm);
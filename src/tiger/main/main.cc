@@ -16,12 +16,18 @@ int main(int argc, char **argv) {
   reg_manager = new frame::X64RegManager();
   frags = new frame::Frags();
 
-  if (argc < 2) {
-    fprintf(stderr, "usage: tiger-compiler file.tig\n");
+  int arg = 1;
+  // instrument allocations for the runtime's allocation-site profile
+  if (argc > 2 && std::string_view(argv[arg]) == "--alloc-profile") {
+    tr::alloc_profile = true;
+    ++arg;
+  }
+  if (arg >= argc) {
+    fprintf(stderr, "usage: tiger-compiler [--alloc-profile] file.tig\n");
     exit(1);
   }
 
-  fname = std::string_view(argv[1]);
+  fname = std::string_view(argv[arg]);
 
   {
     std::unique_ptr<err::ErrorMsg> errormsg;
@@ -29,7 +29,7 @@ void AssemGen::GenAssem(bool need_ra) {
     frag->OutputAssem(out_, phase, need_ra, nullptr);
 
 #ifdef GC_ENABLED
-  auto pmFrags = pm_frags->UpdateNextLink();
+  auto pmFrags = pm_frags->MergePointerMaps();
   phase = frame::Frag::PointerMap;
   fprintf(out_, ".global GLOBAL_GC_ROOTS\n");
   fprintf(out_, ".data\n");
@@ -133,18 +133,13 @@ void PointerMapFrag::OutputAssem(FILE *out, OutputPhase phase, bool need_ra,
 
   this->pointer_map_list->Print(out);
 }
-PointerMapFrag *Frags::UpdateNextLink() {
+PointerMapFrag *Frags::MergePointerMaps() {
   auto *pm_frag = dynamic_cast<PointerMapFrag *>(frags_.front());
   frags_.erase(frags_.begin());
-  if (frags_.empty()) {
-    pm_frag->pointer_map_list->UpdateNext();
-    return pm_frag;
-  }
   for (auto &&frag : frags_) {
     pm_frag->pointer_map_list->AddRoots(
         dynamic_cast<PointerMapFrag *>(frag)->pointer_map_list);
   }
-  pm_frag->pointer_map_list->UpdateNext();
   return pm_frag;
 }
 
@@ -173,4 +168,18 @@ void StringFrag::OutputAssem(FILE *out, OutputPhase phase, bool need_ra,
   }
   fprintf(out, "\"\n");
 }
+
+void DescriptorFrag::OutputAssem(FILE *out, OutputPhase phase, bool need_ra,
+                                 Frag **pointer_frag) const {
+  if (phase != String)
+    return;
+
+  fprintf(out, ".p2align 3\n");
+  fprintf(out, "%s:\n", label_->Name().data());
+  fprintf(out, ".quad %lu\n", field_num_);
+  for (const uint64_t word : bitmap_)
+    fprintf(out, ".quad %#lx\n", word);
+  fprintf(out, ".string \"%s\"\n", name_.data());
+}
+
 } // namespace frame
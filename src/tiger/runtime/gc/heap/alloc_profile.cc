@@ -0,0 +1,84 @@
+#include "alloc_profile.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace gc {
+
+AllocProfile alloc_profile;
+
+void AllocProfile::Initialize() {
+  path_ = getenv("TIGER_ALLOC_PROFILE");
+  // before main registers the flush of the program's output, which must
+  // run first
+  atexit(Exit);
+}
+
+void AllocProfile::Allocated(const void *site, const std::string_view name,
+                             const uint64_t object, const uint64_t bytes) {
+  enabled_ = true;
+  auto iter = index_.find(site);
+  if (iter == index_.end()) {
+    iter = index_.emplace(site, sites_.size()).first;
+    sites_.push_back({name, 0, 0, 0});
+  }
+  Site &stats = sites_[iter->second];
+  ++stats.count;
+  stats.bytes += bytes;
+  objects_.push_back({object, bytes, iter->second});
+}
+
+void AllocProfile::AddWeakRoots(std::vector<uint64_t *> &weak_roots) {
+  for (auto &object : objects_)
+    weak_roots.push_back(&object.start);
+}
+
+void AllocProfile::Collected(std::vector<uint64_t *> &weak_roots) {
+  weak_roots.clear();
+  for (const auto &object : objects_) {
+    if (object.start != 0)
+      sites_[object.site].survived += object.bytes;
+  }
+  objects_.clear();
+}
+
+void AllocProfile::Exit() {
+  if (!alloc_profile.enabled_)
+    return;
+  fflush(stdout);
+  FILE *out = stderr;
+  if (alloc_profile.path_) {
+    out = fopen(alloc_profile.path_, "w");
+    if (!out) {
+      perror(alloc_profile.path_);
+      return;
+    }
+  }
+  alloc_profile.Report(out);
+  if (out != stderr)
+    fclose(out);
+}
+
+void AllocProfile::Report(FILE *out) const {
+  std::vector<const Site *> sorted;
+  uint64_t count = 0, bytes = 0;
+  for (const auto &site : sites_) {
+    sorted.push_back(&site);
+    count += site.count;
+    bytes += site.bytes;
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const Site *a, const Site *b) {
+    return a->bytes > b->bytes;
+  });
+  fprintf(out, "alloc: %lu objects, %lu bytes at %lu sites\n", count, bytes,
+          sites_.size());
+  fprintf(out, "alloc: %12s %10s %12s  %s\n", "bytes", "objects", "survived",
+          "site");
+  for (const auto site : sorted) {
+    fprintf(out, "alloc: %12lu %10lu %12lu  %.*s\n", site->bytes, site->count,
+            site->survived, static_cast<int>(site->name.size()),
+            site->name.data());
+  }
+}
+
+} // namespace gc
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gc {
+
+/**
+ * Allocation-site profile of programs compiled with --alloc-profile.
+ *
+ * Such programs allocate through the *_site runtime functions, which name
+ * the site as "file:line.column type". Per site the profile counts the
+ * objects and bytes allocated and the bytes of the objects that survived
+ * the first collection after their allocation. Until then every object is
+ * a weak root of the heap, so the profile learns whether it survived
+ * without keeping it alive. At exit the sites are reported by bytes
+ * allocated to stderr, or to the file TIGER_ALLOC_PROFILE names.
+ */
+class AllocProfile {
+public:
+  /**
+   * Read the environment and register the report, called once by main.
+   */
+  void Initialize();
+
+  /**
+   * Whether instrumented code has allocated anything.
+   */
+  bool Enabled() const { return enabled_; }
+
+  /**
+   * An object allocated at site.
+   * @param site key of the site, the address of its name
+   * @param object start of the object
+   * @param bytes size the program asked for
+   */
+  void Allocated(const void *site, std::string_view name, uint64_t object,
+                 uint64_t bytes);
+
+  /**
+   * Add the objects followed to the weak roots before a collection.
+   */
+  void AddWeakRoots(std::vector<uint64_t *> &weak_roots);
+
+  /**
+   * Count the objects that survived the collection, then forget them all.
+   */
+  void Collected(std::vector<uint64_t *> &weak_roots);
+
+private:
+  struct Site {
+    std::string_view name;
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t survived;
+  };
+
+  struct Object {
+    uint64_t start;
+    uint64_t bytes;
+    uint64_t site;
+  };
+
+  // atexit handler, it runs on the stack of whoever called exit(), which
+  // tiger code does not keep aligned
+  __attribute__((force_align_arg_pointer)) static void Exit();
+  void Report(FILE *out) const;
+
+  bool enabled_ = false;
+  const char *path_ = nullptr;
+  std::vector<Site> sites_;
+  // site key to index in sites_
+  std::unordered_map<const void *, uint64_t> index_;
+  // objects allocated since the last collection
+  std::vector<Object> objects_;
+};
+
+extern AllocProfile alloc_profile;
+
+} // namespace gc
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "heap.h"
+
+#include <algorithm>
+#include <vector>
+
+// The write barrier emitted by the compiler marks the card of a stored-to
+// address a with
+//   tiger_card_table[(a >> CARD_SHIFT) & tiger_card_mask] = 1
+extern "C" uint64_t *tiger_card_table;
+extern "C" uint64_t tiger_card_mask;
+
+namespace gc {
+
+/**
+ * One word per CARD_SIZE bytes of heap, set when a pointer is stored into
+ * the card. The table has a power of two number of cards indexed modulo its
+ * size, which is enough to give every card of a contiguous heap its own
+ * entry. Every heap owns one because compiled code always marks cards, only
+ * generational heaps read them.
+ */
+class CardTable {
+public:
+  static constexpr uint64_t CARD_SHIFT = 9;
+  static constexpr uint64_t CARD_SIZE = 1 << CARD_SHIFT;
+
+  void Initialize(char *start, uint64_t size) {
+    const uint64_t first = reinterpret_cast<uint64_t>(start) >> CARD_SHIFT;
+    const uint64_t last =
+        (reinterpret_cast<uint64_t>(start) + size - 1) >> CARD_SHIFT;
+    uint64_t num = 1;
+    while (num < last - first + 1)
+      num <<= 1;
+    cards_.assign(num, 0);
+    mask_ = num - 1;
+    tiger_card_table = cards_.data();
+    tiger_card_mask = mask_;
+  }
+
+  bool Dirty(uint64_t address) const {
+    return cards_[(address >> CARD_SHIFT) & mask_] != 0;
+  }
+
+  /**
+   * Mark the cards of [start, end) as the write barrier would.
+   */
+  void DirtyRange(const uint64_t start, const uint64_t end) {
+    for (uint64_t card = start >> CARD_SHIFT; card <= (end - 1) >> CARD_SHIFT;
+         ++card)
+      cards_[card & mask_] = 1;
+  }
+
+  void Clear() { std::fill(cards_.begin(), cards_.end(), 0); }
+
+private:
+  uint64_t mask_ = 0;
+  std::vector<uint64_t> cards_;
+};
+
+} // namespace gc
@@ -0,0 +1,405 @@
+#include "copying_heap.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace gc {
+
+namespace {
+uint64_t RoundUp(const uint64_t size) {
+  if (size == 0)
+    return TigerHeap::WORD_SIZE;
+  return (size + TigerHeap::WORD_SIZE - 1) & ~(TigerHeap::WORD_SIZE - 1);
+}
+} // namespace
+
+char *CopyingHeap::Allocate(const uint64_t size) { return AllocArray(size, true); }
+
+char *CopyingHeap::AllocRecord(const uint64_t size,
+                               const uint64_t *descriptor,
+                               const uint64_t descriptor_size) {
+  const uint64_t words = RoundUp(size) / WORD_SIZE;
+  if (words >= MAX_FIELDS) {
+    fprintf(stderr, "record with %lu fields is too big\n", words);
+    return nullptr;
+  }
+  const uint64_t header = reinterpret_cast<uint64_t>(descriptor) << 16 |
+                          words << TAG_BITS | RECORD;
+  return AllocObject(size, header);
+}
+
+char *CopyingHeap::AllocArray(const uint64_t size, const bool pointers) {
+  return AllocObject(size, RoundUp(size) << TAG_BITS |
+                                (pointers ? ARRAY : DATA));
+}
+
+char *CopyingHeap::AllocString(const uint64_t size) {
+  return AllocObject(size, RoundUp(size) << TAG_BITS | DATA);
+}
+
+char *CopyingHeap::AllocObject(const uint64_t size, const uint64_t header) {
+  const uint64_t total = HEADER_SIZE + RoundUp(size);
+  if (total > LARGE_SIZE)
+    return AllocLarge(total, header);
+  SyncStarts();
+  if (alloc_top_ + total > alloc_limit_ && !NewAllocBlock())
+    return nullptr;
+  *reinterpret_cast<uint64_t *>(alloc_top_) = header;
+  char *start = alloc_top_ + HEADER_SIZE;
+  SetStart(reinterpret_cast<uint64_t>(start));
+  alloc_top_ += total;
+  parsed_ = alloc_top_;
+  used_bytes_ += total;
+  return start;
+}
+
+char *CopyingHeap::AllocLarge(const uint64_t total, const uint64_t header) {
+  const uint64_t run = (total + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  const Space space = LargeSpace();
+  const bool room = space == OLD ? CopyingHeap::CanTakeBlocks(run)
+                                 : CanTakeBlocks(run);
+  uint64_t first = 0, len = 0;
+  for (uint64_t i = 0; room && i < block_num_ && len < run; ++i) {
+    if (blocks_[i].space != FREE) {
+      len = 0;
+      continue;
+    }
+    if (len++ == 0)
+      first = i;
+  }
+  if (len < run) {
+    // only a full collection frees old blocks
+    if (space == OLD)
+      full_gc = true;
+    return nullptr;
+  }
+  for (uint64_t i = first; i < first + run; ++i) {
+    blocks_[i].space = space;
+    blocks_[i].head = first;
+  }
+  blocks_[first].large_run = run;
+  blocks_[first].fill = total;
+  used_blocks_ += run;
+  used_bytes_ += total;
+
+  char *start = BlockStart(first);
+  *reinterpret_cast<uint64_t *>(start) = header;
+  SetStart(reinterpret_cast<uint64_t>(start + HEADER_SIZE));
+  if (space == OLD)
+    TenureLarge(first, header);
+  return start + HEADER_SIZE;
+}
+
+bool CopyingHeap::NewAllocBlock() {
+  if (alloc_block_ >= 0)
+    blocks_[alloc_block_].fill = alloc_top_ - BlockStart(alloc_block_);
+  if (!CanTakeBlocks(1))
+    return false;
+  alloc_block_ = TakeFreeBlock(FROM);
+  if (alloc_block_ < 0)
+    return false;
+  alloc_top_ = parsed_ = BlockStart(alloc_block_);
+  alloc_limit_ = alloc_top_ + BLOCK_SIZE;
+  return true;
+}
+
+void CopyingHeap::SyncStarts() {
+  for (char *object = parsed_; object < alloc_top_;) {
+    const uint64_t size = ObjectSize(*reinterpret_cast<uint64_t *>(object));
+    const uint64_t total = HEADER_SIZE + size;
+    SetStart(reinterpret_cast<uint64_t>(object + HEADER_SIZE));
+    used_bytes_ += total;
+    // the runtime reports its own allocations, these never reached it
+    if (telemetry.Enabled())
+      telemetry.Allocated(size);
+    object += total;
+  }
+  parsed_ = alloc_top_;
+}
+
+int64_t CopyingHeap::TakeFreeBlock(const Space space) {
+  for (uint64_t n = 0; n < block_num_; ++n) {
+    const uint64_t i = free_cursor_;
+    free_cursor_ = (free_cursor_ + 1) % block_num_;
+    if (blocks_[i].space == FREE) {
+      blocks_[i].space = space;
+      blocks_[i].head = i;
+      blocks_[i].large_run = 0;
+      blocks_[i].fill = 0;
+      ++used_blocks_;
+      return static_cast<int64_t>(i);
+    }
+  }
+  return -1;
+}
+
+void CopyingHeap::ReleaseBlock(const uint64_t block) {
+  const uint64_t words_per_block = BLOCK_SIZE / WORD_SIZE / 64;
+  std::fill_n(starts_.begin() + block * words_per_block, words_per_block, 0);
+  blocks_[block].space = FREE;
+  blocks_[block].head = block;
+  blocks_[block].large_run = 0;
+  blocks_[block].fill = 0;
+  --used_blocks_;
+}
+
+uint64_t CopyingHeap::Used() const {
+  return used_bytes_ + (alloc_top_ - parsed_);
+}
+
+uint64_t CopyingHeap::MaxFree() const {
+  uint64_t free_blocks = 0;
+  if (block_num_ / 2 > used_blocks_)
+    free_blocks = block_num_ / 2 - used_blocks_;
+  return free_blocks * BLOCK_SIZE + (alloc_limit_ - alloc_top_);
+}
+
+void CopyingHeap::Initialize(const uint64_t size) {
+  // size is the room for objects, the copy reserve comes on top of it
+  block_num_ = 2 * (size / BLOCK_SIZE);
+  heap_size_ = block_num_ * BLOCK_SIZE;
+  heap_ = static_cast<char *>(malloc(heap_size_));
+  blocks_.resize(block_num_);
+  for (uint64_t i = 0; i < block_num_; ++i)
+    blocks_[i].head = i;
+  starts_.assign(heap_size_ / WORD_SIZE / 64, 0);
+  card_table_.Initialize(heap_, heap_size_);
+}
+
+void CopyingHeap::GC() {
+  GET_TIGER_STACK(this->stack);
+  Collect(this->stack, FROM);
+  // keep bumping in the last block we copied into
+  if (copy_block_ >= 0) {
+    alloc_block_ = copy_block_;
+    alloc_top_ = parsed_ = copy_top_;
+    alloc_limit_ = copy_limit_;
+  }
+}
+
+void CopyingHeap::ForEachLive(const LiveVisitor &visit) const {
+  // only live objects and the neighbours of promoted ones are left
+  for (uint64_t i = 0; i < block_num_; ++i) {
+    if (blocks_[i].space == FREE || blocks_[i].head != i)
+      continue;
+    const char *start = BlockStart(i);
+    for (uint64_t offset = 0; offset < blocks_[i].fill;) {
+      const uint64_t header =
+          *reinterpret_cast<const uint64_t *>(start + offset);
+      const uint64_t size = ObjectSize(header);
+      switch (header & TAG_MASK) {
+      case RECORD:
+        visit(ObjectKind::RECORD, size,
+              reinterpret_cast<const uint64_t *>(header >> 16));
+        break;
+      case ARRAY:
+        visit(ObjectKind::ARRAY, size, nullptr);
+        break;
+      default:
+        visit(ObjectKind::DATA, size, nullptr);
+      }
+      offset += HEADER_SIZE + size;
+    }
+  }
+}
+
+void CopyingHeap::Collect(uint64_t *sp, const Space survivor) {
+  const uint64_t begin = telemetry.Enabled() ? telemetry.Now() : 0;
+  const uint64_t used_before = Used();
+  uint64_t *stack_end = nullptr;
+  std::vector<uint64_t *> dead;
+  std::vector<uint64_t *> slots =
+      pm_manager.GetRootSlots(sp, &stack_end, &dead);
+  slots.insert(slots.end(), runtime_roots.begin(), runtime_roots.end());
+  // the stack scan leaves out both the precise and the dead slots
+  std::vector<uint64_t *> skip = slots;
+  skip.insert(skip.end(), dead.begin(), dead.end());
+  std::sort(skip.begin(), skip.end());
+
+  SyncStarts();
+  if (alloc_block_ >= 0)
+    blocks_[alloc_block_].fill = alloc_top_ - BlockStart(alloc_block_);
+  alloc_block_ = -1;
+  alloc_top_ = alloc_limit_ = parsed_ = nullptr;
+  to_blocks_.clear();
+  copy_block_ = -1;
+  copy_top_ = copy_limit_ = nullptr;
+
+  // Spill the callee-saved registers so that the stack scan sees them
+  jmp_buf registers;
+  setjmp(registers);
+  ScanAmbiguous(skip, stack_end);
+
+  for (const auto slot : slots) {
+    *slot = Forward(*slot);
+  }
+  ScanExtraRoots();
+  ScanBlocks();
+  // objects left in from-space without a forwarding address are dead, a
+  // young collection may already have cleared the slot
+  for (const auto slot : weak_roots) {
+    if (*slot == 0)
+      continue;
+    const uint64_t block = blocks_[BlockOf(*slot)].head;
+    if (blocks_[block].space != FROM)
+      continue;
+    const uint64_t header = *(reinterpret_cast<uint64_t *>(*slot) - 1);
+    *slot = (header & TAG_MASK) == FORWARDED ? header & ~TAG_MASK : 0;
+  }
+
+  used_bytes_ = 0;
+  for (uint64_t i = 0; i < block_num_; ++i) {
+    if (blocks_[i].space == FROM) {
+      ReleaseBlock(i);
+      continue;
+    }
+    if (blocks_[i].space == TO)
+      blocks_[i].space = survivor;
+    used_bytes_ += blocks_[i].fill;
+  }
+  if (telemetry.Enabled()) {
+    telemetry.Marked(used_bytes_);
+    if (used_before > used_bytes_)
+      telemetry.Swept(used_before - used_bytes_);
+    telemetry.Phase("copy", begin, telemetry.Now());
+  }
+}
+
+__attribute__((noinline)) void
+CopyingHeap::ScanAmbiguous(const std::vector<uint64_t *> &slots,
+                           uint64_t *stack_end) {
+  // Everything from this frame up to the end of tigermain, which covers the
+  // runtime frames, the registers saved by GC() and all tiger frames.
+  auto *sp = static_cast<uint64_t *>(__builtin_frame_address(0));
+  for (; sp < stack_end; ++sp) {
+    if (std::binary_search(slots.begin(), slots.end(), sp))
+      continue;
+    PinAmbiguous(*sp);
+  }
+}
+
+void CopyingHeap::PinAmbiguous(const uint64_t word) {
+  if (!InHeap(word))
+    return;
+  const uint64_t block = blocks_[BlockOf(word)].head;
+  if (blocks_[block].space != FROM)
+    return;
+  if (word >= reinterpret_cast<uint64_t>(BlockStart(block)) +
+                  blocks_[block].fill)
+    return;
+  Promote(block);
+}
+
+void CopyingHeap::Promote(const uint64_t block) {
+  const uint64_t run = std::max<uint64_t>(blocks_[block].large_run, 1);
+  for (uint64_t i = block; i < block + run; ++i)
+    blocks_[i].space = TO;
+  to_blocks_.emplace_back(block);
+}
+
+uint64_t CopyingHeap::Forward(const uint64_t address) {
+  if (!InHeap(address))
+    return address;
+  const uint64_t block = blocks_[BlockOf(address)].head;
+  if (blocks_[block].space != FROM || !IsStart(address))
+    return address;
+  if (blocks_[block].large_run) {
+    Promote(block);
+    return address;
+  }
+  const uint64_t header = *(reinterpret_cast<uint64_t *>(address) - 1);
+  if ((header & TAG_MASK) == FORWARDED)
+    return header & ~TAG_MASK;
+  return Copy(address);
+}
+
+uint64_t CopyingHeap::Copy(const uint64_t address) {
+  const auto from = reinterpret_cast<char *>(address) - HEADER_SIZE;
+  const uint64_t header = *reinterpret_cast<uint64_t *>(from);
+  const uint64_t total = HEADER_SIZE + ObjectSize(header);
+  if (copy_top_ + total > copy_limit_) {
+    copy_block_ = TakeFreeBlock(TO);
+    if (copy_block_ < 0) {
+      fprintf(stderr, "out of memory during copying gc\n");
+      exit(-1);
+    }
+    to_blocks_.emplace_back(copy_block_);
+    copy_top_ = BlockStart(copy_block_);
+    copy_limit_ = copy_top_ + BLOCK_SIZE;
+  }
+  memcpy(copy_top_, from, total);
+  const auto to = reinterpret_cast<uint64_t>(copy_top_ + HEADER_SIZE);
+  SetStart(to);
+  *reinterpret_cast<uint64_t *>(from) = to | FORWARDED;
+  copy_top_ += total;
+  blocks_[copy_block_].fill += total;
+  return to;
+}
+
+void CopyingHeap::ScanBlocks() {
+  // to_blocks_ grows while we scan, the last block also grows in place
+  for (uint64_t i = 0; i < to_blocks_.size(); ++i) {
+    const uint64_t block = to_blocks_[i];
+    char *start = BlockStart(block);
+    for (uint64_t offset = 0; offset < blocks_[block].fill;) {
+      const uint64_t header = *reinterpret_cast<uint64_t *>(start + offset);
+      ScanObject(reinterpret_cast<uint64_t>(start + offset + HEADER_SIZE));
+      offset += HEADER_SIZE + ObjectSize(header);
+    }
+  }
+}
+
+void CopyingHeap::ScanObject(const uint64_t address) {
+  const uint64_t header = *(reinterpret_cast<uint64_t *>(address) - 1);
+  ScanFields(address, 0, ObjectSize(header) / WORD_SIZE);
+}
+
+void CopyingHeap::ScanFields(const uint64_t address, const uint64_t from,
+                             const uint64_t to) {
+  const uint64_t header = *(reinterpret_cast<uint64_t *>(address) - 1);
+  auto *fields = reinterpret_cast<uint64_t *>(address);
+  if ((header & TAG_MASK) == RECORD) {
+    const auto descriptor = reinterpret_cast<const uint64_t *>(header >> 16);
+    for (uint64_t word = from / 64; word * 64 < to; ++word) {
+      uint64_t bits = descriptor[word];
+      // drop the fields outside [from, to)
+      if (word == from / 64)
+        bits &= ~0ull << (from % 64);
+      if ((word + 1) * 64 > to)
+        bits &= ~(~0ull << (to % 64));
+      for (; bits; bits &= bits - 1) {
+        const uint64_t i = word * 64 + __builtin_ctzll(bits);
+        fields[i] = Forward(fields[i]);
+      }
+    }
+  } else if ((header & TAG_MASK) == ARRAY) {
+    // elements are pointers or nil, int arrays are DATA and never scanned
+    for (uint64_t i = from; i < to; ++i)
+      fields[i] = Forward(fields[i]);
+  }
+}
+
+uint64_t CopyingHeap::ObjectSize(const uint64_t header) {
+  if ((header & TAG_MASK) == RECORD)
+    return ((header >> TAG_BITS) & (MAX_FIELDS - 1)) * WORD_SIZE;
+  return header >> TAG_BITS;
+}
+
+void CopyingHeap::SetStart(const uint64_t address) {
+  const uint64_t idx =
+      (address - reinterpret_cast<uint64_t>(heap_)) / WORD_SIZE;
+  starts_[idx / 64] |= 1ull << (idx % 64);
+}
+
+bool CopyingHeap::IsStart(const uint64_t address) const {
+  if (address % WORD_SIZE)
+    return false;
+  const uint64_t idx =
+      (address - reinterpret_cast<uint64_t>(heap_)) / WORD_SIZE;
+  return starts_[idx / 64] >> (idx % 64) & 1;
+}
+
+} // namespace gc
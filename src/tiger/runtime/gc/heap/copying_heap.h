@@ -0,0 +1,186 @@
+#pragma once
+
+#include "card_table.h"
+#include "heap.h"
+#include "pointer_map.h"
+#include "telemetry.h"
+
+#include <vector>
+
+// Bump pointer of the current allocation block, compiled code allocates
+// records inline from it and only calls alloc_record when it runs out
+extern "C" char *tiger_heap_top;
+extern "C" char *tiger_heap_limit;
+
+namespace gc {
+
+/**
+ * Semispace copying heap collected with Cheney's breadth-first copy.
+ *
+ * The heap is cut into fixed-size blocks and each semispace is a set of
+ * blocks, so allocation is a bump of the pointer inside the current block.
+ * At most half of the blocks may be in use, the other half is the copy
+ * reserve, which is allocated in addition to the requested heap size.
+ * Roots found through the pointer maps are updated in place.
+ *
+ * Pointers that the compiler keeps in temporaries across a call are not in
+ * the pointer maps, so the rest of the stack and the registers are scanned
+ * conservatively and any block they point into is promoted as a whole
+ * instead of being evacuated (Bartlett's mostly-copying scheme). Objects too
+ * big for a block get a run of blocks of their own and are never moved.
+ *
+ * Every object is preceded by one header word:
+ *   record:    descriptor << 16 | field count << 3 | RECORD
+ *   array:     size in bytes << 3 | ARRAY, elements are pointers or nil
+ *   data:      size in bytes << 3 | DATA, int arrays and strings
+ *   forwarded: new address | FORWARDED
+ * The record layout is also built by the inline allocation the compiler
+ * emits (RecordExp::Translate). Those objects have no start bit until the
+ * runtime parses the allocation block in SyncStarts().
+ */
+class CopyingHeap : public TigerHeap {
+public:
+  CopyingHeap() = default;
+
+  char *Allocate(uint64_t size) override;
+
+  char *AllocRecord(uint64_t size, const uint64_t *descriptor,
+                    uint64_t descriptor_size) override;
+  char *AllocArray(uint64_t size, bool pointers) override;
+  char *AllocString(uint64_t size) override;
+
+  uint64_t Used() const override;
+
+  uint64_t MaxFree() const override;
+
+  void Initialize(uint64_t size) override;
+
+  void GC() override;
+
+  void ForEachLive(const LiveVisitor &visit) const override;
+
+protected:
+  static constexpr uint64_t BLOCK_SIZE = 4096;
+  // objects bigger than this get their own run of blocks
+  static constexpr uint64_t LARGE_SIZE = BLOCK_SIZE / 4;
+  static constexpr uint64_t HEADER_SIZE = WORD_SIZE;
+
+  enum Tag : uint64_t {
+    RECORD = 0,
+    ARRAY = 1,
+    FORWARDED = 2,
+    DATA = 3,
+    TAG_MASK = 7
+  };
+  static constexpr uint64_t TAG_BITS = 3;
+  // field count bits of a record header
+  static constexpr uint64_t MAX_FIELDS = 1 << (16 - TAG_BITS);
+
+  // OLD is only used by GenerationalHeap, FROM blocks are the nursery there
+  enum Space : uint8_t { FREE, FROM, TO, OLD };
+
+  struct Block {
+    Space space = FREE;
+    // first block of the large object this block belongs to
+    uint64_t head = 0;
+    // number of blocks of the large object starting here, 0 if small
+    uint64_t large_run = 0;
+    // bytes filled from the block start
+    uint64_t fill = 0;
+  };
+
+  /**
+   * Evacuate the live objects of the FROM blocks.
+   * Blocks that survive end up in the survivor space.
+   * @param sp tiger stack captured by GC()
+   */
+  void Collect(uint64_t *sp, Space survivor);
+
+  /**
+   * Roots other than the stack, such as the remembered set.
+   */
+  virtual void ScanExtraRoots() {}
+
+  /**
+   * Whether the mutator may take n more blocks before the next GC.
+   */
+  virtual bool CanTakeBlocks(uint64_t n) const {
+    return used_blocks_ + n <= block_num_ / 2;
+  }
+
+  /**
+   * Space of the blocks of new large objects. CanTakeBlocks() limits FROM
+   * runs, OLD runs only need room in the heap.
+   */
+  virtual Space LargeSpace() const { return FROM; }
+
+  /**
+   * Called with the first block of a new large object run in OLD.
+   */
+  virtual void TenureLarge(uint64_t first, uint64_t header) {}
+
+  char *AllocObject(uint64_t size, uint64_t header);
+  char *AllocLarge(uint64_t total, uint64_t header);
+  bool NewAllocBlock();
+  int64_t TakeFreeBlock(Space space);
+  void ReleaseBlock(uint64_t block);
+
+  /**
+   * Account for the objects compiled code allocated in the current
+   * allocation block since the runtime last looked at it.
+   */
+  void SyncStarts();
+
+  uint64_t BlockOf(uint64_t address) const {
+    return (address - reinterpret_cast<uint64_t>(heap_)) / BLOCK_SIZE;
+  }
+  char *BlockStart(uint64_t block) const { return heap_ + block * BLOCK_SIZE; }
+  bool InHeap(uint64_t address) const {
+    const auto start = reinterpret_cast<uint64_t>(heap_);
+    return address >= start && address < start + heap_size_;
+  }
+
+  void SetStart(uint64_t address);
+  bool IsStart(uint64_t address) const;
+
+  static uint64_t ObjectSize(uint64_t header);
+
+  void ScanAmbiguous(const std::vector<uint64_t *> &slots,
+                     uint64_t *stack_end);
+  void PinAmbiguous(uint64_t word);
+  void Promote(uint64_t block);
+  uint64_t Forward(uint64_t address);
+  uint64_t Copy(uint64_t address);
+  void ScanObject(uint64_t address);
+  void ScanFields(uint64_t address, uint64_t from, uint64_t to);
+  void ScanBlocks();
+
+  char *heap_ = nullptr;
+  uint64_t heap_size_ = 0;
+  uint64_t block_num_ = 0;
+  std::vector<Block> blocks_;
+  // one bit per heap word, set at the first word of every object's body
+  std::vector<uint64_t> starts_;
+  // next block to look at when searching for a free one
+  uint64_t free_cursor_ = 0;
+  uint64_t used_blocks_ = 0;
+  uint64_t used_bytes_ = 0;
+
+  // bump pointer of the current allocation block, shared with compiled code
+  char *&alloc_top_ = tiger_heap_top;
+  char *&alloc_limit_ = tiger_heap_limit;
+  int64_t alloc_block_ = -1;
+  // objects below this in the allocation block have their start bit set
+  char *parsed_ = nullptr;
+
+  // to-space blocks in the order Cheney scans them
+  std::vector<uint64_t> to_blocks_;
+  char *copy_top_ = nullptr;
+  char *copy_limit_ = nullptr;
+  int64_t copy_block_ = -1;
+
+  PointerMapManager pm_manager;
+  CardTable card_table_;
+};
+
+} // namespace gc
@@ -1,31 +1,77 @@
 #include "derived_heap.h"
 
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
 namespace gc {
 
-char *DerivedHeap::Allocate(const uint64_t size) {
-  return heap_manger_.Alloc(size);
-}
-char *DerivedHeap::AllocRecord(const uint64_t size, unsigned char *descriptor,
+char *DerivedHeap::Allocate(const uint64_t size) { return AllocArray(size, true); }
+char *DerivedHeap::AllocRecord(const uint64_t size,
+                               const uint64_t *descriptor,
                                const uint64_t descriptor_size) {
-  const auto start = Allocate(size);
-  if (start == nullptr) {
+  const uint64_t words = HeapManger::RoundUp(size) / WORD_SIZE;
+  if (words >= (1 << 14)) {
+    fprintf(stderr, "record with %lu fields is too big\n", words);
     return nullptr;
   }
-  auto record = RecordInfo(start, size, descriptor, descriptor_size);
-  records_.emplace_back(record);
-  return start;
+  const uint64_t header =
+      reinterpret_cast<uint64_t>(descriptor) << 16 | words << 2 | RECORD;
+  return AllocObject(size, header);
+}
+char *DerivedHeap::AllocArray(const uint64_t size, const bool pointers) {
+  return AllocObject(size, HeapManger::RoundUp(size) << 2 |
+                                (pointers ? ARRAY : DATA));
 }
-char *DerivedHeap::AllocArray(const uint64_t size) {
-  const auto start = Allocate(size);
-  if (!start) {
+char *DerivedHeap::AllocString(const uint64_t size) {
+  return AllocObject(size, HeapManger::RoundUp(size) << 2 | DATA);
+}
+char *DerivedHeap::AllocObject(const uint64_t size, const uint64_t header) {
+  const uint64_t total = HEADER_SIZE + HeapManger::RoundUp(size);
+  // ask for a collection once this cycle's allocation budget is spent, the
+  // retry right after the collection may go over it
+  if (!collected_ && live_bytes_ + allocated_ + total > threshold_) {
+    return nullptr;
+  }
+  if (total >= LARGE_SIZE) {
+    char *block = large_.Alloc(total);
+    if (!block) {
+      return nullptr;
+    }
+    collected_ = false;
+    allocated_ += total;
+    *reinterpret_cast<uint64_t *>(block) = header;
+    return block + HEADER_SIZE;
+  }
+  char *block = heap_manger_.Alloc(total);
+  // sweep lazily until the request fits
+  while (!block && SweepChunk()) {
+    block = heap_manger_.Alloc(total);
+  }
+  if (!block && Grow(total)) {
+    block = heap_manger_.Alloc(total);
+  }
+  if (!block) {
     return nullptr;
   }
-  auto array = ArrayInfo(start, size);
-  arrays_.emplace_back(array);
+  collected_ = false;
+  allocated_ += total;
+  *reinterpret_cast<uint64_t *>(block) = header;
+  char *start = block + HEADER_SIZE;
+  const uint64_t idx = WordIndex(reinterpret_cast<uint64_t>(start));
+  SetBit(starts_, idx);
+  // allocate black where the sweep has not got to yet
+  if (idx / 64 >= sweep_cursor_) {
+    SetBit(marks_, idx);
+  }
   return start;
 }
 
-uint64_t DerivedHeap::Used() const { return heap_manger_.Used(); }
+uint64_t DerivedHeap::Used() const {
+  return heap_manger_.Used() + large_.Used();
+}
 uint64_t DerivedHeap::MaxFree() const {
   const auto max_size = heap_manger_.MaxFree();
   if (heap_size_ / 2 > max_size) {
@@ -33,92 +79,591 @@ uint64_t DerivedHeap::MaxFree() const {
   }
   return max_size;
 }
+void DerivedHeap::FreeSpace(uint64_t *free, uint64_t *max_free) const {
+  *free = heap_manger_.Free();
+  *max_free = heap_manger_.MaxFree();
+}
 void DerivedHeap::Initialize(const uint64_t size) {
-  heap_ = static_cast<char *>(malloc(size));
+  uint64_t reserve = std::max(DEFAULT_RESERVE, size);
+  if (const char *max = getenv("TIGER_HEAP_MAX")) {
+    reserve = std::max<uint64_t>(strtoull(max, nullptr, 0), size);
+  }
+  const char *thp = getenv("TIGER_HEAP_THP");
+  if (!region_.Reserve(reserve, size, thp && strcmp(thp, "0") != 0)) {
+    fprintf(stderr, "cannot reserve the heap\n");
+    exit(-1);
+  }
+  heap_ = region_.Start();
   heap_size_ = size;
-  heap_manger_.SetFree(reinterpret_cast<uint64_t>(heap_), size);
+  heap_manger_.AddRegion(reinterpret_cast<uint64_t>(heap_), size);
+  starts_.assign(size / WORD_SIZE / 64 + 1, 0);
+  marks_.assign(starts_.size(), 0);
+  sweep_cursor_ = starts_.size();
+  // cards are never read here, sharing them between distant addresses
+  // once the heap grows is harmless
+  card_table_.Initialize(heap_, size);
+  if (const char *threads = getenv("TIGER_GC_THREADS")) {
+    mark_threads_ = std::max(atoll(threads), 1ll);
+  }
+  if (const char *growth = getenv("TIGER_GC_GROWTH")) {
+    growth_ = std::max(atof(growth), 1.0);
+  }
+  if (const char *compact = getenv("TIGER_GC_COMPACT")) {
+    compact_threshold_ = atof(compact);
+  }
+  min_threshold_ = threshold_ = size;
 }
 void DerivedHeap::GC() {
   GET_TIGER_STACK(this->stack);
   Mark(this->stack);
-  Sweep();
+  if (compact_) {
+    Compact(this->stack);
+  }
+  // the next collection starts when the heap has grown by growth_
+  threshold_ = std::max(min_threshold_,
+                        static_cast<uint64_t>(live_bytes_ * growth_));
+  allocated_ = 0;
+  collected_ = true;
+}
+void DerivedHeap::ForEachLive(const LiveVisitor &visit) const {
+  const auto report = [&visit](const uint64_t start) {
+    const uint64_t header = Header(start);
+    const uint64_t size = ObjectSize(header);
+    switch (header & TAG_MASK) {
+    case RECORD:
+      visit(ObjectKind::RECORD, size,
+            reinterpret_cast<const uint64_t *>(header >> 16));
+      break;
+    case ARRAY:
+      visit(ObjectKind::ARRAY, size, nullptr);
+      break;
+    default:
+      visit(ObjectKind::DATA, size, nullptr);
+    }
+  };
+  // the unswept words hold marked objects, a compaction leaves none
+  const auto heap_start = reinterpret_cast<uint64_t>(heap_);
+  for (uint64_t i = 0; i < starts_.size(); ++i) {
+    const uint64_t live = i < sweep_cursor_ ? starts_[i] : marks_[i];
+    for (uint64_t bits = live; bits; bits &= bits - 1) {
+      report(heap_start + (i * 64 + __builtin_ctzll(bits)) * WORD_SIZE);
+    }
+  }
+  // Mark() already unmapped the dead large objects
+  large_.ForEach(
+      [&report](const uint64_t block) { report(block + HEADER_SIZE); });
+}
+bool DerivedHeap::Grow(const uint64_t needed) {
+  const uint64_t old_size = heap_size_;
+  uint64_t new_size = old_size + std::max(needed, old_size / 2);
+  new_size = (new_size + GROW_ALIGN - 1) & ~(GROW_ALIGN - 1);
+  new_size = std::min(new_size, region_.Reserved());
+  if (new_size < old_size + needed || !region_.Commit(new_size)) {
+    return false;
+  }
+  const bool sweep_done = sweep_cursor_ >= starts_.size();
+  heap_size_ = new_size;
+  starts_.resize(new_size / WORD_SIZE / 64 + 1, 0);
+  marks_.resize(starts_.size(), 0);
+  if (sweep_done) {
+    sweep_cursor_ = starts_.size();
+  }
+  heap_manger_.AddRegion(reinterpret_cast<uint64_t>(heap_) + old_size,
+                         new_size - old_size);
+  return true;
 }
 void DerivedHeap::Mark(uint64_t *sp) {
-  const std::vector<uint64_t> roots_address = pm_manager.GetRootAddress(sp);
-  for (auto &address : roots_address) {
-    DFS(address);
+  // the marks of the last cycle are still needed by its sweep
+  if (telemetry.Enabled()) {
+    const uint64_t begin = telemetry.Now();
+    Sweep();
+    telemetry.Phase("sweep", begin, telemetry.Now());
+  } else {
+    Sweep();
+  }
+  // all free space is in the free lists now
+  compact_ = compact_threshold_ < 1 && Fragmentation() >= compact_threshold_;
+  const uint64_t mark_begin = telemetry.Enabled() ? telemetry.Now() : 0;
+  uint64_t *stack_end = nullptr;
+  std::vector<uint64_t *> dead;
+  std::vector<uint64_t *> slots =
+      pm_manager.GetRootSlots(sp, &stack_end, &dead);
+  slots.insert(slots.end(), runtime_roots.begin(), runtime_roots.end());
+  std::vector<uint64_t> roots_address;
+  for (const auto slot : slots) {
+    roots_address.emplace_back(*slot);
+  }
+  // the stack scan leaves out both the precise and the dead slots
+  slots.insert(slots.end(), dead.begin(), dead.end());
+  std::sort(slots.begin(), slots.end());
+
+  // Spill the callee-saved registers so that the stack scan sees them
+  jmp_buf registers;
+  setjmp(registers);
+  ScanAmbiguous(slots, stack_end);
+  roots_address.insert(roots_address.end(), ambiguous_.begin(),
+                       ambiguous_.end());
+  live_bytes_ = 0;
+  if (mark_threads_ > 1) {
+    ParallelMark(roots_address);
+  } else {
+    for (auto &address : roots_address) {
+      MarkAndPush(address, mark_stack_);
+    }
+    DrainMarkStack();
+  }
+  sweep_cursor_ = 0;
+  const auto heap_start = reinterpret_cast<uint64_t>(heap_);
+  for (const auto slot : weak_roots) {
+    if (*slot == 0) {
+      continue;
+    }
+    const bool live =
+        *slot >= heap_start && *slot < heap_start + heap_size_
+            ? TestBit(marks_, WordIndex(*slot))
+            : large_.Marked(*slot - HEADER_SIZE);
+    if (!live) {
+      *slot = 0;
+    }
+  }
+  // large objects are few, sweep them right away to give their pages back
+  const uint64_t large_freed = large_.Sweep();
+  if (telemetry.Enabled()) {
+    telemetry.Swept(large_freed);
+    telemetry.Marked(live_bytes_);
+    telemetry.Phase("mark", mark_begin, telemetry.Now());
   }
 }
-void DerivedHeap::Sweep() {
-  auto array_iter = arrays_.begin();
-  while (array_iter != arrays_.end()) {
-    if (array_iter->Marked()) {
-      array_iter->Unmark();
-      ++array_iter;
-    } else {
-      heap_manger_.SetFree(reinterpret_cast<uint64_t>(array_iter->start),
-                           array_iter->size);
-      array_iter = arrays_.erase(array_iter);
+void DerivedHeap::MarkAndPush(const uint64_t x, std::vector<uint64_t> &stack) {
+  uint64_t start = 0;
+  if (InHeapAndMark(x, &start)) {
+    stack.emplace_back(start);
+  }
+}
+void DerivedHeap::DrainMarkStack() {
+  // Popped objects go through a small FIFO so that their header and fields
+  // are prefetched a few objects ahead of the scan.
+  uint64_t fifo[PREFETCH_DEPTH];
+  uint64_t head = 0, count = 0;
+  while (!mark_stack_.empty() || count != 0) {
+    if (!mark_stack_.empty() && count < PREFETCH_DEPTH) {
+      const uint64_t start = mark_stack_.back();
+      mark_stack_.pop_back();
+      __builtin_prefetch(reinterpret_cast<char *>(start) - HEADER_SIZE);
+      fifo[(head + count++) % PREFETCH_DEPTH] = start;
+      continue;
     }
+    const uint64_t start = fifo[head];
+    head = (head + 1) % PREFETCH_DEPTH;
+    --count;
+    live_bytes_ += ScanObject(start, mark_stack_);
   }
-  auto record_iter = records_.begin();
-  while (record_iter != records_.end()) {
-    if (record_iter->Marked()) {
-      record_iter->Unmark();
-      ++record_iter;
-    } else {
-      heap_manger_.SetFree(reinterpret_cast<uint64_t>(record_iter->start),
-                           record_iter->size);
-      record_iter = records_.erase(record_iter);
+}
+uint64_t DerivedHeap::ScanObject(const uint64_t start,
+                                 std::vector<uint64_t> &stack) {
+  const uint64_t header = Header(start);
+  const auto fields = reinterpret_cast<uint64_t *>(start);
+  const uint64_t size = ObjectSize(header) / WORD_SIZE;
+  if ((header & TAG_MASK) == RECORD) {
+    const auto descriptor = reinterpret_cast<const uint64_t *>(header >> 16);
+    for (uint64_t word = 0; word * 64 < size; ++word) {
+      for (uint64_t bits = descriptor[word]; bits; bits &= bits - 1) {
+        MarkAndPush(fields[word * 64 + __builtin_ctzll(bits)], stack);
+      }
+    }
+  } else if ((header & TAG_MASK) == ARRAY) {
+    // elements are pointers or nil, int arrays are DATA and never scanned
+    for (uint64_t i = 0; i < size; ++i) {
+      MarkAndPush(fields[i], stack);
     }
   }
+  return HEADER_SIZE + ObjectSize(header);
 }
-bool DerivedHeap::InHeap(const uint64_t x) const {
-  for (const auto &record : records_) {
-    if (record.InRecord(x))
-      return true;
+// tiger frames do not keep the stack 16-byte aligned, which libc expects
+// when creating threads
+__attribute__((force_align_arg_pointer)) void
+DerivedHeap::ParallelMark(const std::vector<uint64_t> &roots) {
+  std::vector<std::vector<uint64_t>> stacks(mark_threads_);
+  std::vector<MarkDeque> deques(mark_threads_);
+  deques_.swap(deques);
+  parallel_ = true;
+  // split the roots round robin
+  for (uint64_t i = 0; i < roots.size(); ++i) {
+    MarkAndPush(roots[i], stacks[i % mark_threads_]);
   }
-  for (const auto &array : arrays_) {
-    if (array.InArray(x))
-      return true;
+  busy_ = mark_threads_;
+  std::vector<std::thread> threads;
+  for (uint64_t id = 1; id < mark_threads_; ++id) {
+    threads.emplace_back(&DerivedHeap::MarkWorker, this, id,
+                         std::ref(stacks[id]));
   }
-  return false;
+  MarkWorker(0, stacks[0]);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  parallel_ = false;
 }
-bool DerivedHeap::InHeapAndMark(const uint64_t x, RecordInfo **info) {
-  for (auto &&record : records_) {
-    if (record.IsRecordStart(x)) {
-      if (record.Marked()) {
-        return false;
+void DerivedHeap::MarkWorker(const uint64_t id, std::vector<uint64_t> &stack) {
+  MarkDeque &own = deques_[id];
+  uint64_t live_bytes = 0;
+  while (true) {
+    while (!stack.empty()) {
+      // keep half of a big stack where idle threads can steal it
+      if (stack.size() > 64) {
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.objects.empty()) {
+          const auto half = stack.begin() + stack.size() / 2;
+          own.objects.insert(own.objects.end(), stack.begin(), half);
+          stack.erase(stack.begin(), half);
+        }
       }
-      record.Mark();
-      *info = &record;
-      return true;
+      const uint64_t start = stack.back();
+      stack.pop_back();
+      if (!stack.empty()) {
+        __builtin_prefetch(reinterpret_cast<char *>(stack.back()) -
+                           HEADER_SIZE);
+      }
+      live_bytes += ScanObject(start, stack);
+    }
+    if (TakeWork(id, stack)) {
+      continue;
+    }
+    // idle, wait until someone publishes work or everybody is idle
+    --busy_;
+    while (true) {
+      if (busy_ == 0) {
+        __atomic_fetch_add(&live_bytes_, live_bytes, __ATOMIC_RELAXED);
+        return;
+      }
+      if (HasWork()) {
+        ++busy_;
+        if (TakeWork(id, stack)) {
+          break;
+        }
+        --busy_;
+      }
+      std::this_thread::yield();
     }
   }
-  for (auto &&array : arrays_) {
-    if (array.InArray(x)) {
-      if (array.Marked())
-        return false;
-      array.Mark();
+}
+bool DerivedHeap::HasWork() {
+  for (auto &deque : deques_) {
+    std::lock_guard<std::mutex> guard(deque.lock);
+    if (!deque.objects.empty()) {
       return true;
     }
   }
   return false;
 }
-void DerivedHeap::DFS(const uint64_t x) {
-  RecordInfo *record_info = nullptr;
-  if (InHeapAndMark(x, &record_info)) {
-    if (record_info) {
-      const auto start = reinterpret_cast<uint64_t>(record_info->start);
-      const auto size = record_info->descriptor_size;
-      for (uint64_t i = 0; i < size; ++i) {
-        const auto f = reinterpret_cast<uint64_t *>(start + WORD_SIZE * i);
-        if (const uint64_t field = start + WORD_SIZE * i; record_info->descriptor_name[i] == '1') {
-          DFS(*f);
+bool DerivedHeap::TakeWork(const uint64_t id, std::vector<uint64_t> &stack) {
+  for (uint64_t i = 0; i < deques_.size(); ++i) {
+    MarkDeque &deque = deques_[(id + i) % deques_.size()];
+    std::lock_guard<std::mutex> guard(deque.lock);
+    if (deque.objects.empty()) {
+      continue;
+    }
+    // the owner takes everything, thieves take half from the old end
+    const uint64_t count =
+        i == 0 ? deque.objects.size() : (deque.objects.size() + 1) / 2;
+    stack.insert(stack.end(), deque.objects.begin(),
+                 deque.objects.begin() + count);
+    deque.objects.erase(deque.objects.begin(), deque.objects.begin() + count);
+    return true;
+  }
+  return false;
+}
+void DerivedHeap::Sweep() {
+  while (SweepChunk()) {
+  }
+}
+bool DerivedHeap::SweepChunk() {
+  if (sweep_cursor_ >= starts_.size()) {
+    return false;
+  }
+  const uint64_t end = std::min(sweep_cursor_ + SWEEP_CHUNK, starts_.size());
+  const uint64_t used = heap_manger_.Used();
+  // a run of adjacent dead objects is freed as one block
+  uint64_t run = 0, run_end = 0;
+  for (uint64_t i = sweep_cursor_; i < end; ++i) {
+    // free every object that starts in this word and is not marked
+    uint64_t dead = starts_[i] & ~marks_[i];
+    starts_[i] &= marks_[i];
+    marks_[i] = 0;
+    while (dead) {
+      const uint64_t idx = i * 64 + __builtin_ctzll(dead);
+      dead &= dead - 1;
+      const auto start = reinterpret_cast<uint64_t>(heap_) + idx * WORD_SIZE;
+      const uint64_t block = start - HEADER_SIZE;
+      if (block != run_end) {
+        if (run != run_end) {
+          heap_manger_.SetFree(run, run_end - run);
         }
+        run = block;
       }
+      run_end = start + ObjectSize(Header(start));
     }
   }
+  if (run != run_end) {
+    heap_manger_.SetFree(run, run_end - run);
+  }
+  sweep_cursor_ = end;
+  if (telemetry.Enabled()) {
+    telemetry.Swept(used - heap_manger_.Used());
+  }
+  return true;
+}
+void DerivedHeap::Compact(uint64_t *sp) {
+  const uint64_t begin = telemetry.Enabled() ? telemetry.Now() : 0;
+  const uint64_t used_before = heap_manger_.Used();
+  std::vector<uint64_t *> slots = pm_manager.GetRootSlots(sp);
+  slots.insert(slots.end(), runtime_roots.begin(), runtime_roots.end());
+
+  // pin what the stack scan of Mark() found, large objects never move
+  const auto heap_start = reinterpret_cast<uint64_t>(heap_);
+  pins_.assign(marks_.size(), 0);
+  for (const uint64_t start : ambiguous_) {
+    if (start >= heap_start && start < heap_start + heap_size_) {
+      SetBit(pins_, WordIndex(start));
+    }
+  }
+
+  // Compute the new addresses, objects keep their order and a pinned
+  // object leaves a free gap before it
+  forward_.assign(marks_.size(), 0);
+  std::vector<std::pair<uint64_t, uint64_t>> gaps;
+  uint64_t to = heap_start;
+  uint64_t used = 0;
+  for (uint64_t i = 0; i < marks_.size(); ++i) {
+    forward_[i] = to;
+    for (uint64_t bits = marks_[i]; bits; bits &= bits - 1) {
+      const uint64_t start =
+          heap_start + (i * 64 + __builtin_ctzll(bits)) * WORD_SIZE;
+      const uint64_t size = HEADER_SIZE + ObjectSize(Header(start));
+      used += size;
+      if (pins_[i] & (bits & -bits)) {
+        if (start - HEADER_SIZE > to) {
+          gaps.emplace_back(to, start - HEADER_SIZE - to);
+        }
+        to = start - HEADER_SIZE + size;
+      } else {
+        to += size;
+      }
+    }
+  }
+  gaps.emplace_back(to, heap_start + heap_size_ - to);
+
+  // Update the roots and the fields of the marked objects while every
+  // header is still in place. Relocate() maps old addresses only, so a slot
+  // listed twice must be updated once.
+  std::vector<uint64_t *> weak = weak_roots;
+  for (auto *roots : {&slots, &weak}) {
+    std::sort(roots->begin(), roots->end());
+    roots->erase(std::unique(roots->begin(), roots->end()), roots->end());
+    for (const auto slot : *roots) {
+      *slot = Relocate(*slot);
+    }
+  }
+  for (uint64_t i = 0; i < marks_.size(); ++i) {
+    for (uint64_t bits = marks_[i]; bits; bits &= bits - 1) {
+      RelocateFields(heap_start +
+                     (i * 64 + __builtin_ctzll(bits)) * WORD_SIZE);
+    }
+  }
+  // large objects never move, but may point to objects that do
+  large_.ForEach(
+      [this](const uint64_t block) { RelocateFields(block + HEADER_SIZE); });
+
+  // Slide, an object only overwrites objects that have already moved
+  std::fill(starts_.begin(), starts_.end(), 0);
+  to = heap_start;
+  for (uint64_t i = 0; i < marks_.size(); ++i) {
+    for (uint64_t bits = marks_[i]; bits; bits &= bits - 1) {
+      const uint64_t start =
+          heap_start + (i * 64 + __builtin_ctzll(bits)) * WORD_SIZE;
+      const uint64_t size = HEADER_SIZE + ObjectSize(Header(start));
+      uint64_t new_start = start;
+      if (pins_[i] & (bits & -bits)) {
+        to = start - HEADER_SIZE + size;
+      } else {
+        new_start = to + HEADER_SIZE;
+        if (new_start != start) {
+          memmove(reinterpret_cast<char *>(to),
+                  reinterpret_cast<char *>(start - HEADER_SIZE), size);
+        }
+        to += size;
+      }
+      SetBit(starts_, WordIndex(new_start));
+    }
+  }
+  std::fill(marks_.begin(), marks_.end(), 0);
+  sweep_cursor_ = starts_.size();
+
+  heap_manger_.Reset(used);
+  for (const auto &[loc, size] : gaps) {
+    heap_manger_.AddRegion(loc, size);
+  }
+  if (telemetry.Enabled()) {
+    telemetry.Swept(used_before - used);
+    telemetry.Phase("compact", begin, telemetry.Now());
+  }
+}
+__attribute__((noinline)) void
+DerivedHeap::ScanAmbiguous(const std::vector<uint64_t *> &slots,
+                           uint64_t *stack_end) {
+  // Everything from this frame up to the end of tigermain, which covers the
+  // runtime frames, the registers saved by Mark() and all tiger frames.
+  ambiguous_.clear();
+  auto *sp = static_cast<uint64_t *>(__builtin_frame_address(0));
+  for (; sp < stack_end; ++sp) {
+    if (std::binary_search(slots.begin(), slots.end(), sp)) {
+      continue;
+    }
+    // any word inside an object keeps it, records included
+    uint64_t start = FindStart(*sp);
+    if (start == 0) {
+      const uint64_t block = large_.Find(*sp);
+      if (block == 0 || *sp < block + HEADER_SIZE) {
+        continue;
+      }
+      start = block + HEADER_SIZE;
+    }
+    ambiguous_.emplace_back(start);
+  }
+}
+uint64_t DerivedHeap::NewAddress(const uint64_t start) const {
+  const uint64_t idx = WordIndex(start);
+  if (TestBit(pins_, idx)) {
+    return start;
+  }
+  // slide past the objects before it in the same bitmap word
+  const auto heap_start = reinterpret_cast<uint64_t>(heap_);
+  const uint64_t word = idx / 64;
+  uint64_t to = forward_[word];
+  for (uint64_t bits = marks_[word] & ((1ull << (idx % 64)) - 1); bits;
+       bits &= bits - 1) {
+    const uint64_t before =
+        heap_start + (word * 64 + __builtin_ctzll(bits)) * WORD_SIZE;
+    const uint64_t size = HEADER_SIZE + ObjectSize(Header(before));
+    to = pins_[word] & (bits & -bits) ? before - HEADER_SIZE + size
+                                      : to + size;
+  }
+  return to + HEADER_SIZE;
+}
+uint64_t DerivedHeap::Relocate(const uint64_t x) const {
+  const auto heap_start = reinterpret_cast<uint64_t>(heap_);
+  if (x < heap_start || x >= heap_start + heap_size_) {
+    return x;
+  }
+  uint64_t start = x;
+  if (x % WORD_SIZE || !TestBit(starts_, WordIndex(x))) {
+    start = FindStart(x);
+    if (start == 0 || (Header(start) & TAG_MASK) == RECORD) {
+      return x;
+    }
+  }
+  if (!TestBit(marks_, WordIndex(start))) {
+    return x;
+  }
+  return NewAddress(start) + (x - start);
+}
+void DerivedHeap::RelocateFields(const uint64_t start) const {
+  const uint64_t header = Header(start);
+  const auto fields = reinterpret_cast<uint64_t *>(start);
+  const uint64_t size = ObjectSize(header) / WORD_SIZE;
+  if ((header & TAG_MASK) == RECORD) {
+    const auto descriptor = reinterpret_cast<const uint64_t *>(header >> 16);
+    for (uint64_t word = 0; word * 64 < size; ++word) {
+      for (uint64_t bits = descriptor[word]; bits; bits &= bits - 1) {
+        const uint64_t k = word * 64 + __builtin_ctzll(bits);
+        fields[k] = Relocate(fields[k]);
+      }
+    }
+  } else if ((header & TAG_MASK) == ARRAY) {
+    for (uint64_t k = 0; k < size; ++k) {
+      fields[k] = Relocate(fields[k]);
+    }
+  }
+}
+bool DerivedHeap::InHeap(const uint64_t x) const {
+  return FindStart(x) != 0 || large_.Find(x) != 0;
+}
+bool DerivedHeap::InHeapAndMark(const uint64_t x, uint64_t *marked) {
+  const auto heap_start = reinterpret_cast<uint64_t>(heap_);
+  if (x < heap_start || x >= heap_start + heap_size_) {
+    return MarkLarge(x, marked);
+  }
+  uint64_t start = x;
+  if (x % WORD_SIZE || !TestBit(starts_, WordIndex(x))) {
+    start = FindStart(x);
+    if (start == 0 || (Header(start) & TAG_MASK) == RECORD) {
+      return false;
+    }
+  }
+  const uint64_t idx = WordIndex(start);
+  if (parallel_) {
+    // another thread may mark the same object or a neighbour in this word
+    const uint64_t bit = 1ull << (idx % 64);
+    if (__atomic_load_n(&marks_[idx / 64], __ATOMIC_RELAXED) & bit ||
+        __atomic_fetch_or(&marks_[idx / 64], bit, __ATOMIC_RELAXED) & bit) {
+      return false;
+    }
+  } else {
+    if (TestBit(marks_, idx)) {
+      return false;
+    }
+    SetBit(marks_, idx);
+  }
+  *marked = start;
+  return true;
+}
+bool DerivedHeap::MarkLarge(const uint64_t x, uint64_t *marked) {
+  const uint64_t block = large_.Find(x);
+  if (block == 0) {
+    return false;
+  }
+  const uint64_t start = block + HEADER_SIZE;
+  if (x < start || (x != start && (Header(start) & TAG_MASK) == RECORD)) {
+    return false;
+  }
+  if (!large_.Mark(block, parallel_)) {
+    return false;
+  }
+  *marked = start;
+  return true;
+}
+uint64_t DerivedHeap::FindStart(const uint64_t x) const {
+  const auto heap_start = reinterpret_cast<uint64_t>(heap_);
+  if (x < heap_start || x >= heap_start + heap_size_) {
+    return 0;
+  }
+  // the closest start at or before x, then check x is inside that object
+  const uint64_t idx = WordIndex(x);
+  uint64_t word = idx / 64;
+  uint64_t bits = starts_[word] & (~0ull >> (63 - idx % 64));
+  while (bits == 0) {
+    if (word == 0) {
+      return 0;
+    }
+    bits = starts_[--word];
+  }
+  const uint64_t start =
+      heap_start + (word * 64 + 63 - __builtin_clzll(bits)) * WORD_SIZE;
+  if (x >= start + ObjectSize(Header(start))) {
+    return 0;
+  }
+  return start;
+}
+double DerivedHeap::Fragmentation() const {
+  const uint64_t free = heap_manger_.Free();
+  if (free == 0) {
+    return 0;
+  }
+  return 1 - static_cast<double>(heap_manger_.MaxFree()) / free;
+}
+uint64_t DerivedHeap::ObjectSize(const uint64_t header) {
+  if ((header & TAG_MASK) == RECORD)
+    return ((header >> 2) & ((1 << 14) - 1)) * WORD_SIZE;
+  return header >> 2;
 }
 
 } // namespace gc
@@ -1,215 +1,554 @@
 #pragma once
 
+#include "card_table.h"
 #include "heap.h"
+#include "large_object_space.h"
+#include "pointer_map.h"
+#include "region.h"
+#include "telemetry.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
-#include <map>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <set>
 #include <vector>
 
 namespace gc {
-class PointerMapNode {
+/**
+ * Free space manager of the heap.
+ * Small blocks (up to SMALL_MAX bytes) are kept in exact-size segregated free
+ * lists threaded through the free blocks themselves, so allocating a small
+ * record or array is a pop from its size class. Larger blocks live in a
+ * best-fit tree ordered by size. Used and free bytes are tracked as counters.
+ *
+ * A block that is freed next to a free block is merged with it, so no two
+ * free blocks are ever adjacent. The neighbours are found through two
+ * bitmaps over the managed memory, one bit per granule, which mark the
+ * first and the last granule of every free block. A free block holds:
+ *   GRANULE bytes: nothing, no object fits, it waits for a neighbour
+ *   small:         next and previous block of its class
+ *   large:         its size, in the first and in the last word
+ */
+class HeapManger {
 public:
-  uint64_t label = 0;
-  uint64_t next_label = 0;
-  uint64_t key = 0;
-  uint64_t frame_size = 0;
-  uint64_t in_main = 0;
-  std::vector<int64_t> offsets;
-  PointerMapNode() = default;
-};
-class PointerMapManager {
-  std::vector<PointerMapNode> pointer_map_;
+  static constexpr uint64_t GRANULE = 8;
+  static constexpr uint64_t SMALL_MAX = 256;
+  static constexpr uint64_t CLASS_NUM = SMALL_MAX / GRANULE;
 
-public:
-  PointerMapManager() { Init(); }
-  void Init() {
-    uint64_t *cur = &GLOBAL_GC_ROOTS;
-    while (true) {
-      PointerMapNode node;
-      node.label = reinterpret_cast<uint64_t>(cur);
-      node.next_label = *(cur++);
-      node.key = *(cur++);
-      node.frame_size = *(cur++);
-      node.in_main = *(cur++);
-      while (true) {
-        int64_t offset = *(cur++);
-        if (offset == -1)
-          break;
-        node.offsets.emplace_back(offset);
-      }
-      pointer_map_.emplace_back(node);
-      if (node.next_label == 0)
-        break;
-    }
+  HeapManger() { std::fill(std::begin(classes_), std::end(classes_), 0); }
+
+  static uint64_t RoundUp(const uint64_t size) {
+    if (size == 0)
+      return GRANULE;
+    return (size + GRANULE - 1) & ~(GRANULE - 1);
   }
 
-  std::vector<uint64_t> GetRootAddress(uint64_t *sp) {
-    std::vector<uint64_t> address;
-    bool in_main = false;
-    while (!in_main) {
-      const uint64_t ret_add = *(sp);
-      for (const auto &pm : pointer_map_) {
-        if (pm.key == ret_add) {
-          for (const int64_t offset : pm.offsets) {
-            const auto pointer_add = reinterpret_cast<uint64_t *>(
-                offset + reinterpret_cast<int64_t>(sp + 1) +
-                static_cast<int64_t>(pm.frame_size));
-            address.emplace_back(*pointer_add);
-          }
-          sp += (pm.frame_size / 8 + 1);
-          in_main = pm.in_main;
-          break;
-        }
-      }
+  /**
+   * Hand a fresh region to the manager, it is free but was never used.
+   * Regions are handed over in address order from a single reservation.
+   */
+  void AddRegion(const uint64_t loc, const uint64_t size) {
+    if (base_ == 0)
+      base_ = loc;
+    if (loc + size > limit_) {
+      limit_ = loc + size;
+      const uint64_t words = (limit_ - base_) / GRANULE / 64 + 1;
+      free_starts_.resize(words, 0);
+      free_ends_.resize(words, 0);
     }
-    return address;
+    free_ += size;
+    PutFree(loc, size);
   }
-};
 
-class HeapManger {
-public:
-  HeapManger() = default;
-  void SetFree(uint64_t loc, uint64_t size) {
-    if (used_map_.find(loc) != used_map_.end())
-      used_map_.erase(loc);
-    free_map_[loc] = size;
-  }
-  char *Alloc(const uint64_t size) {
-    auto iter = free_map_.begin();
-    for (; iter != free_map_.end(); ++iter) {
-      const auto loc = iter->first;
-      const auto free_size = iter->second;
-      if (free_size > size) {
-        // can have a new free space
-        free_map_[loc + size] = free_size - size;
-        used_map_[loc] = size;
-        break;
-      }
-      if (free_size == size) {
-        used_map_[loc] = size;
-        break;
-      }
+  /**
+   * Return an allocated block to the manager.
+   */
+  void SetFree(const uint64_t loc, uint64_t size) {
+    size = RoundUp(size);
+    used_ -= size;
+    free_ += size;
+    PutFree(loc, size);
+  }
+
+  char *Alloc(uint64_t size) {
+    size = RoundUp(size);
+    uint64_t loc = 0;
+    if (size <= SMALL_MAX) {
+      loc = AllocSmall(size);
     }
-    if (iter != free_map_.end()) {
-      free_map_.erase(iter);
-      return reinterpret_cast<char *>(iter.operator*().first);
+    if (loc == 0) {
+      loc = AllocLarge(size);
     }
-    return nullptr;
+    if (loc == 0)
+      return nullptr;
+    used_ += size;
+    free_ -= size;
+    return reinterpret_cast<char *>(loc);
   }
-  uint64_t Used() const {
-    uint64_t used = 0;
-    for (const auto &map : used_map_) {
-      const auto used_size = map.second;
-      used += used_size;
-    }
-    return used;
+
+  /**
+   * Forget every free block, the caller hands the free space back with
+   * AddRegion.
+   * @param used bytes taken by the blocks left allocated
+   */
+  void Reset(const uint64_t used) {
+    std::fill(std::begin(classes_), std::end(classes_), 0);
+    class_bits_ = 0;
+    large_.clear();
+    std::fill(free_starts_.begin(), free_starts_.end(), 0);
+    std::fill(free_ends_.begin(), free_ends_.end(), 0);
+    used_ = used;
+    free_ = 0;
   }
+
+  uint64_t Used() const { return used_; }
+  uint64_t Free() const { return free_; }
+
   uint64_t MaxFree() const {
     uint64_t max_size = 0;
-    for (const auto &map : free_map_) {
-      const auto free_size = map.second;
-      max_size = std::max(max_size, free_size);
+    if (!large_.empty())
+      max_size = large_.rbegin()->first;
+    if (class_bits_ != 0) {
+      const uint64_t idx = 63 - __builtin_clzll(class_bits_);
+      max_size = std::max(max_size, ClassSize(idx));
     }
     return max_size;
   }
 
 private:
-  std::map<uint64_t, uint64_t> free_map_;
-  std::map<uint64_t, uint64_t> used_map_;
-};
+  // size of the blocks in class idx
+  static uint64_t ClassSize(const uint64_t idx) { return (idx + 1) * GRANULE; }
+  static uint64_t ClassIndex(const uint64_t size) {
+    return size / GRANULE - 1;
+  }
 
-class RecordInfo {
-public:
-  char *start;
-  uint64_t size;
-  bool marked = false;
-  unsigned char *descriptor_name = nullptr;
-  uint64_t descriptor_size = 0;
-
-  RecordInfo() {
-    start = nullptr;
-    size = 0;
-  }
-  RecordInfo(char *start, uint64_t size, unsigned char *des_name,
-             uint64_t des_size)
-      : start(start), size(size), descriptor_name(des_name),
-        descriptor_size(des_size) {}
-  bool IsRecordStart(const uint64_t address) {
+  static uint64_t &Word(const uint64_t loc, const uint64_t idx) {
+    return reinterpret_cast<uint64_t *>(loc)[idx];
+  }
+  uint64_t Granule(const uint64_t loc) const { return (loc - base_) / GRANULE; }
+  static bool TestBit(const std::vector<uint64_t> &bits, uint64_t idx) {
+    return bits[idx / 64] >> (idx % 64) & 1;
+  }
+  static void SetBit(std::vector<uint64_t> &bits, uint64_t idx) {
+    bits[idx / 64] |= 1ull << (idx % 64);
+  }
+  static void ClearBit(std::vector<uint64_t> &bits, uint64_t idx) {
+    bits[idx / 64] &= ~(1ull << (idx % 64));
+  }
+
+  void PushClass(const uint64_t idx, const uint64_t loc) {
+    const uint64_t next = classes_[idx];
+    Word(loc, 0) = next;
+    Word(loc, 1) = 0;
+    if (next != 0)
+      Word(next, 1) = loc;
+    classes_[idx] = loc;
+    class_bits_ |= 1ull << idx;
+  }
+  void RemoveClass(const uint64_t idx, const uint64_t loc) {
+    const uint64_t next = Word(loc, 0);
+    const uint64_t prev = Word(loc, 1);
+    if (prev != 0)
+      Word(prev, 0) = next;
+    else
+      classes_[idx] = next;
+    if (next != 0)
+      Word(next, 1) = prev;
+    if (classes_[idx] == 0)
+      class_bits_ &= ~(1ull << idx);
+  }
+
+  /**
+   * Size of the free block starting at loc. A small block ends within
+   * CLASS_NUM granules, a large one records its size.
+   */
+  uint64_t FreeSizeAt(const uint64_t loc) const {
+    const uint64_t first = Granule(loc);
+    for (uint64_t g = first; g < first + CLASS_NUM; ++g) {
+      if (TestBit(free_ends_, g))
+        return (g - first + 1) * GRANULE;
+    }
+    return Word(loc, 0);
+  }
+  /**
+   * Start of the free block ending at end.
+   */
+  uint64_t FreeStartBefore(const uint64_t end) const {
+    const uint64_t last = Granule(end) - 1;
+    for (uint64_t g = last; g + CLASS_NUM > last && g != ~0ull; --g) {
+      if (TestBit(free_starts_, g))
+        return base_ + g * GRANULE;
+    }
+    return end - Word(end - GRANULE, 0);
+  }
+
+  /**
+   * Make the block at loc free without looking at its neighbours.
+   */
+  void Link(const uint64_t loc, const uint64_t size) {
     if (size == 0)
-      return false;
-    return address == reinterpret_cast<uint64_t>(start);
+      return;
+    SetBit(free_starts_, Granule(loc));
+    SetBit(free_ends_, Granule(loc + size) - 1);
+    if (size == GRANULE)
+      return;
+    if (size <= SMALL_MAX) {
+      PushClass(ClassIndex(size), loc);
+    } else {
+      Word(loc, 0) = size;
+      Word(loc + size - GRANULE, 0) = size;
+      large_.emplace(size, loc);
+    }
+  }
+  /**
+   * Take the free block at loc out of the manager.
+   */
+  void Unlink(const uint64_t loc, const uint64_t size) {
+    ClearBit(free_starts_, Granule(loc));
+    ClearBit(free_ends_, Granule(loc + size) - 1);
+    if (size == GRANULE)
+      return;
+    if (size <= SMALL_MAX)
+      RemoveClass(ClassIndex(size), loc);
+    else
+      large_.erase({size, loc});
   }
-  bool InRecord(const uint64_t address) const {
+
+  /**
+   * Make the block at loc free, merged with the free blocks around it.
+   */
+  void PutFree(uint64_t loc, uint64_t size) {
     if (size == 0)
-      return false;
-    const int64_t delta =
-        static_cast<int64_t>(address) - reinterpret_cast<int64_t>(start);
-    return (delta >= 0 && delta <= (size - 8));
-  }
-  bool Marked() const { return marked; }
-  void Mark() { marked = true; }
-  void Unmark() { marked = false; }
-};
+      return;
+    const uint64_t end = loc + size;
+    if (end < limit_ && TestBit(free_starts_, Granule(end))) {
+      const uint64_t next = FreeSizeAt(end);
+      Unlink(end, next);
+      size += next;
+    }
+    if (loc > base_ && TestBit(free_ends_, Granule(loc) - 1)) {
+      const uint64_t prev = FreeStartBefore(loc);
+      Unlink(prev, loc - prev);
+      size += loc - prev;
+      loc = prev;
+    }
+    Link(loc, size);
+  }
 
-class ArrayInfo {
-public:
-  char *start;
-  uint64_t size;
-  bool marked = false;
+  // The split tails below go back with Link(): their right neighbour was
+  // the neighbour of a free block, so it is in use.
+  uint64_t AllocSmall(const uint64_t size) {
+    const uint64_t idx = ClassIndex(size);
+    if (classes_[idx] != 0) {
+      const uint64_t loc = classes_[idx];
+      Unlink(loc, size);
+      return loc;
+    }
+    // fall back to the smallest bigger small block, the tail goes back to
+    // its own class
+    const uint64_t bigger = class_bits_ & ~((2ull << idx) - 1);
+    if (bigger == 0)
+      return 0;
+    const uint64_t found = __builtin_ctzll(bigger);
+    const uint64_t loc = classes_[found];
+    Unlink(loc, ClassSize(found));
+    Link(loc + size, ClassSize(found) - size);
+    return loc;
+  }
 
-  ArrayInfo() {
-    start = nullptr;
-    size = 0;
+  uint64_t AllocLarge(const uint64_t size) {
+    const auto iter = large_.lower_bound({size, 0});
+    if (iter == large_.end())
+      return 0;
+    const auto [free_size, loc] = *iter;
+    Unlink(loc, free_size);
+    Link(loc + size, free_size - size);
+    return loc;
   }
-  ArrayInfo(char *start, uint64_t size) : start(start), size(size) {}
-  bool InArray(const uint64_t address) const {
-    if (size == 0)
-      return false;
-    const int64_t delta =
-        static_cast<int64_t>(address) - reinterpret_cast<int64_t>(start);
-    return (delta >= 0 && delta <= (size - 8));
-  }
-  bool Marked() const { return marked; }
-  void Mark() { marked = true; }
-  void Unmark() { marked = false; }
+
+  uint64_t classes_[CLASS_NUM];
+  uint64_t class_bits_ = 0;
+  // best-fit tree of (size, start) for blocks bigger than SMALL_MAX
+  std::set<std::pair<uint64_t, uint64_t>> large_;
+  // managed memory is [base_, limit_)
+  uint64_t base_ = 0;
+  uint64_t limit_ = 0;
+  // first and last granule of every free block
+  std::vector<uint64_t> free_starts_;
+  std::vector<uint64_t> free_ends_;
+  uint64_t used_ = 0;
+  uint64_t free_ = 0;
 };
 
+/**
+ * Mark-sweep heap on top of HeapManger.
+ *
+ * Every object is preceded by one header word:
+ *   record: descriptor << 16 | field count << 2 | RECORD
+ *   array:  size in bytes << 2 | ARRAY, elements are pointers or nil
+ *   data:   size in bytes << 2 | DATA, int arrays and strings
+ * Object starts and marks are bitmaps with one bit per heap word, so testing
+ * whether a word points to an object and marking it is constant time and
+ * sweeping is a linear walk of the start bitmap. The sweep is lazy: GC()
+ * only marks, allocations sweep a chunk at a time until they fit and the
+ * next GC() finishes what is left. Until then dead objects count as used.
+ * Marking is driven by an explicit mark stack, data objects are never
+ * scanned.
+ *
+ * The roots are the slots the pointer maps list as live at each call. The
+ * compiler also keeps pointers in temporaries across calls, so the rest of
+ * the stack and the registers are scanned conservatively and any object a
+ * word points into is marked as well. Slots the maps know to be dead are
+ * left out of that scan.
+ *
+ * The heap is a region reserved with mmap (TIGER_HEAP_MAX bytes, huge pages
+ * with TIGER_HEAP_THP=1) that is committed as it grows. An allocation asks
+ * for a collection once the bytes allocated since the last one plus the
+ * bytes it found live exceed TIGER_GC_GROWTH (default 2) times those live
+ * bytes; the heap only grows when an allocation does not fit after that.
+ *
+ * With TIGER_GC_THREADS set to more than one, marking runs on that many
+ * threads. Each has a private mark stack and publishes part of it on a
+ * deque that idle threads steal from, mark bits are set atomically.
+ *
+ * When at least TIGER_GC_COMPACT (default 0.5, 1 turns it off) of the free
+ * bytes are outside the largest free block, the mark is followed by a
+ * sliding (Lisp-2) compaction instead of a sweep, which leaves a single free
+ * block at the end of the heap. New addresses are kept per bitmap word and
+ * derived from the headers of the objects before them in that word, so the
+ * compaction needs no extra header word. Objects found by the conservative
+ * scan are pinned in place.
+ *
+ * Objects of LARGE_SIZE bytes or more, in practice big arrays, bypass the
+ * free lists and get pages of their own in a LargeObjectSpace. They are
+ * never moved and are unmapped as soon as a mark finds them dead.
+ */
 class DerivedHeap : public TigerHeap {
 public:
   DerivedHeap() = default;
 
   char *Allocate(uint64_t size) override;
 
-  char *AllocRecord(uint64_t size, unsigned char *descriptor,
+  char *AllocRecord(uint64_t size, const uint64_t *descriptor,
                     uint64_t descriptor_size) override;
-  char *AllocArray(uint64_t size) override;
+  char *AllocArray(uint64_t size, bool pointers) override;
+  char *AllocString(uint64_t size) override;
+
+  // large objects get fresh pages, which the OS zeroes on first touch
+  bool ZeroFilled(const uint64_t size) const override {
+    return HEADER_SIZE + HeapManger::RoundUp(size) >= LARGE_SIZE;
+  }
 
   uint64_t Used() const override;
 
   uint64_t MaxFree() const override;
 
+  void FreeSpace(uint64_t *free, uint64_t *max_free) const override;
+
   void Initialize(uint64_t size) override;
 
   void GC() override;
 
+  void ForEachLive(const LiveVisitor &visit) const override;
+
   void Mark(uint64_t *sp);
 
+  /**
+   * Finish the sweep of the last collection.
+   */
   void Sweep();
 
+  /**
+   * Sweep the next SWEEP_CHUNK words of the bitmaps.
+   * @return false if there was nothing left to sweep
+   */
+  bool SweepChunk();
+
   bool InHeap(uint64_t x) const;
 
-  bool InHeapAndMark(uint64_t x, RecordInfo **info);
+  /**
+   * Mark the object x points to.
+   * Records are only reached through their start, arrays and data also
+   * through interior pointers.
+   * @param marked set to the start of the marked object
+   * @return whether an unmarked object was found and marked
+   */
+  bool InHeapAndMark(uint64_t x, uint64_t *marked);
 
-  void DFS(uint64_t x);
+  /**
+   * Slide the objects marked by the last Mark() to the start of the heap
+   * and update every pointer to them.
+   */
+  void Compact(uint64_t *sp);
 
 private:
+  static constexpr uint64_t HEADER_SIZE = WORD_SIZE;
+
+  enum Tag : uint64_t { RECORD = 0, ARRAY = 1, DATA = 2, TAG_MASK = 3 };
+
+  // bitmap words swept at a time, 64 * 64 heap words
+  static constexpr uint64_t SWEEP_CHUNK = 64;
+
+  // objects popped from the mark stack wait this long for their prefetch
+  static constexpr uint64_t PREFETCH_DEPTH = 8;
+
+  // address space reserved unless TIGER_HEAP_MAX says otherwise
+  static constexpr uint64_t DEFAULT_RESERVE = 1ull << 32;
+  static constexpr uint64_t GROW_ALIGN = 1 << 20;
+
+  // objects this big, header included, go to the large object space
+  static constexpr uint64_t LARGE_SIZE = 1 << 15;
+
+  char *AllocObject(uint64_t size, uint64_t header);
+
+  /**
+   * Commit more of the reserved region, at least needed bytes.
+   */
+  bool Grow(uint64_t needed);
+
+  // gray objects a marking thread shares with thieves
+  struct MarkDeque {
+    std::mutex lock;
+    std::deque<uint64_t> objects;
+  };
+
+  /**
+   * Mark the object x points to and push it to the mark stack.
+   */
+  void MarkAndPush(uint64_t x, std::vector<uint64_t> &stack);
+
+  /**
+   * Scan objects from the mark stack until it is empty.
+   */
+  void DrainMarkStack();
+
+  /**
+   * Push the unmarked objects the object at start points to.
+   * @return bytes taken by the object
+   */
+  uint64_t ScanObject(uint64_t start, std::vector<uint64_t> &stack);
+
+  /**
+   * InHeapAndMark() for pointers outside the heap region.
+   */
+  bool MarkLarge(uint64_t x, uint64_t *marked);
+
+  void ParallelMark(const std::vector<uint64_t> &roots);
+
+  /**
+   * Body of marking thread id, returns when no thread has gray objects.
+   */
+  void MarkWorker(uint64_t id, std::vector<uint64_t> &stack);
+
+  /**
+   * Take gray objects from the own deque, or else steal from another one.
+   */
+  bool TakeWork(uint64_t id, std::vector<uint64_t> &stack);
+  bool HasWork();
+
+  static uint64_t ObjectSize(uint64_t header);
+  static uint64_t Header(uint64_t address) {
+    return *(reinterpret_cast<uint64_t *>(address) - 1);
+  }
+
+  uint64_t WordIndex(uint64_t address) const {
+    return (address - reinterpret_cast<uint64_t>(heap_)) / WORD_SIZE;
+  }
+  static bool TestBit(const std::vector<uint64_t> &bits, uint64_t idx) {
+    return bits[idx / 64] >> (idx % 64) & 1;
+  }
+  static void SetBit(std::vector<uint64_t> &bits, uint64_t idx) {
+    bits[idx / 64] |= 1ull << (idx % 64);
+  }
+  static void ClearBit(std::vector<uint64_t> &bits, uint64_t idx) {
+    bits[idx / 64] &= ~(1ull << (idx % 64));
+  }
+
+  /**
+   * Start of the object containing x, 0 if x is before the first object.
+   */
+  uint64_t FindStart(uint64_t x) const;
+
+  /**
+   * Share of the free bytes outside the largest free block.
+   */
+  double Fragmentation() const;
+
+  /**
+   * Collect in ambiguous_ the objects that words of the stack other than
+   * the given slots point into.
+   * @param slots sorted slots to leave out
+   */
+  void ScanAmbiguous(const std::vector<uint64_t *> &slots,
+                     uint64_t *stack_end);
+
+  /**
+   * Address the marked object at start is moved to by Compact().
+   */
+  uint64_t NewAddress(uint64_t start) const;
+
+  /**
+   * Where the pointer x points after Compact(), x itself if its object
+   * does not move.
+   */
+  uint64_t Relocate(uint64_t x) const;
+
+  /**
+   * Relocate() the pointer fields of the object at start.
+   */
+  void RelocateFields(uint64_t start) const;
+
+  Region region_;
   char *heap_ = nullptr;
+  // committed bytes
   uint64_t heap_size_ = 0;
   HeapManger heap_manger_;
-  std::vector<RecordInfo> records_;
-  std::vector<ArrayInfo> arrays_;
+  LargeObjectSpace large_;
+
+  // bytes of the objects found live by the last mark
+  uint64_t live_bytes_ = 0;
+  // bytes allocated since the last collection
+  uint64_t allocated_ = 0;
+  // collect when live_bytes_ + allocated_ would exceed this
+  uint64_t threshold_ = 0;
+  uint64_t min_threshold_ = 0;
+  // TIGER_GC_GROWTH, the heap may grow to this times the live bytes
+  double growth_ = 2.0;
+  // set by GC() so that the allocation retried after it is not refused
+  bool collected_ = false;
+  // one bit per heap word, set at the first word of every object's body
+  std::vector<uint64_t> starts_;
+  // one bit per heap word, set at the start of every marked object
+  std::vector<uint64_t> marks_;
+  // bitmap words before this one are swept, objects allocated after it are
+  // marked so the sweep keeps them
+  uint64_t sweep_cursor_ = 0;
+  // marked objects whose fields are not scanned yet
+  std::vector<uint64_t> mark_stack_;
+
+  // TIGER_GC_COMPACT, compact once the fragmentation reaches this
+  double compact_threshold_ = 0.5;
+  // set by Mark() when GC() should compact instead of sweeping
+  bool compact_ = false;
+  // starts of the objects the last Mark() found through stack words outside
+  // the pointer maps, Compact() pins them
+  std::vector<uint64_t> ambiguous_;
+  // one bit per heap word, set at the start of every pinned object
+  std::vector<uint64_t> pins_;
+  // per bitmap word, where Compact() slides the first object starting in it
+  std::vector<uint64_t> forward_;
+
+  uint64_t mark_threads_ = 1;
+  // set while ParallelMark runs, mark bits are then set atomically
+  bool parallel_ = false;
+  std::vector<MarkDeque> deques_;
+  // threads that may still produce gray objects
+  std::atomic<uint64_t> busy_{0};
   PointerMapManager pm_manager;
+  CardTable card_table_;
 };
 
 } // namespace gc
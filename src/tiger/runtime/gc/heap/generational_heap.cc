@@ -0,0 +1,98 @@
+#include "generational_heap.h"
+
+#include <algorithm>
+
+namespace gc {
+
+void GenerationalHeap::Initialize(const uint64_t size) {
+  // the old generation may fill size, the nursery comes on top of it
+  const uint64_t nursery = size / 4;
+  CopyingHeap::Initialize(size + nursery);
+  nursery_blocks_ = std::max<uint64_t>(nursery / BLOCK_SIZE, 1);
+}
+
+void GenerationalHeap::GC() {
+  GET_TIGER_STACK(this->stack);
+  YoungGC(this->stack);
+  if (full_gc || old_blocks_ + nursery_blocks_ > block_num_ / 2)
+    FullGC(this->stack);
+  full_gc = false;
+}
+
+void GenerationalHeap::YoungGC(uint64_t *sp) {
+  young_gc_ = true;
+  Collect(sp, OLD);
+  young_gc_ = false;
+  card_table_.Clear();
+  old_blocks_ = used_blocks_;
+}
+
+void GenerationalHeap::FullGC(uint64_t *sp) {
+  for (auto &block : blocks_) {
+    if (block.space == OLD)
+      block.space = FROM;
+  }
+  Collect(sp, OLD);
+  card_table_.Clear();
+  old_blocks_ = used_blocks_;
+}
+
+bool GenerationalHeap::CanTakeBlocks(const uint64_t n) const {
+  return used_blocks_ - old_blocks_ + n <= nursery_blocks_ &&
+         used_blocks_ + n <= block_num_ / 2;
+}
+
+void GenerationalHeap::TenureLarge(const uint64_t first,
+                                   const uint64_t header) {
+  old_blocks_ += blocks_[first].large_run;
+  // the runtime fills a new array without the write barrier, and its
+  // initial value may be young
+  if ((header & TAG_MASK) != DATA) {
+    const auto start = reinterpret_cast<uint64_t>(BlockStart(first));
+    card_table_.DirtyRange(start, start + blocks_[first].fill);
+  }
+}
+
+void GenerationalHeap::ScanExtraRoots() {
+  if (!young_gc_)
+    return;
+  // remembered set: old objects with a dirty card may point into the nursery
+  for (uint64_t i = 0; i < block_num_; ++i) {
+    const Block &block = blocks_[i];
+    if (block.space != OLD || block.head != i)
+      continue;
+    const auto start = reinterpret_cast<uint64_t>(BlockStart(i));
+    const uint64_t end = start + block.fill;
+    bool dirty = false;
+    for (uint64_t card = start; card < end && !dirty;
+         card += CardTable::CARD_SIZE)
+      dirty = card_table_.Dirty(card);
+    if (block.fill != 0 && card_table_.Dirty(end - 1))
+      dirty = true;
+    if (!dirty)
+      continue;
+    for (uint64_t offset = start; offset < end;) {
+      const uint64_t header = *reinterpret_cast<uint64_t *>(offset);
+      ScanDirtyObject(offset + HEADER_SIZE);
+      offset += HEADER_SIZE + ObjectSize(header);
+    }
+  }
+}
+
+void GenerationalHeap::ScanDirtyObject(const uint64_t address) {
+  const uint64_t header = *(reinterpret_cast<uint64_t *>(address) - 1);
+  const uint64_t words = ObjectSize(header) / WORD_SIZE;
+  // visit the fields card by card, skipping the clean ones
+  for (uint64_t i = 0; i < words;) {
+    const uint64_t field = address + i * WORD_SIZE;
+    const uint64_t card_end =
+        ((field >> CardTable::CARD_SHIFT) + 1) << CardTable::CARD_SHIFT;
+    const uint64_t next =
+        std::min(words, (card_end - address + WORD_SIZE - 1) / WORD_SIZE);
+    if (card_table_.Dirty(field))
+      ScanFields(address, i, next);
+    i = next;
+  }
+}
+
+} // namespace gc
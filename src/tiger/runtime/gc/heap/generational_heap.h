@@ -0,0 +1,53 @@
+#pragma once
+
+#include "copying_heap.h"
+
+namespace gc {
+
+/**
+ * Two generations on top of the block heap of CopyingHeap.
+ *
+ * The mutator bump-allocates into a nursery of at most nursery_blocks_
+ * blocks. A young collection evacuates the live nursery objects straight
+ * into old blocks, using the stack roots plus the old objects whose cards
+ * were dirtied by the compiler-emitted write barrier. When the old
+ * generation leaves no room for another nursery, a full copying collection
+ * of both generations follows. Large objects are allocated straight into
+ * old blocks.
+ */
+class GenerationalHeap : public CopyingHeap {
+public:
+  GenerationalHeap() = default;
+
+  void Initialize(uint64_t size) override;
+
+  void GC() override;
+
+  /**
+   * Collect the nursery only, survivors are promoted to the old generation.
+   * @param sp tiger stack captured by GC()
+   */
+  void YoungGC(uint64_t *sp);
+
+  /**
+   * Collect both generations.
+   * @param sp tiger stack captured by GC()
+   */
+  void FullGC(uint64_t *sp);
+
+protected:
+  void ScanExtraRoots() override;
+  bool CanTakeBlocks(uint64_t n) const override;
+  // large objects skip the nursery, which may be smaller than them
+  Space LargeSpace() const override { return OLD; }
+  void TenureLarge(uint64_t first, uint64_t header) override;
+
+private:
+  void ScanDirtyObject(uint64_t address);
+
+  uint64_t nursery_blocks_ = 0;
+  uint64_t old_blocks_ = 0;
+  bool young_gc_ = false;
+};
+
+} // namespace gc
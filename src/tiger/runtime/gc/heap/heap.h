@@ -1,6 +1,8 @@
 #pragma once
 
+#include <functional>
 #include <stdint.h>
+#include <vector>
 
 // Used to locate the start of ptrmap, simply get the address by
 // &GLOBAL_GC_ROOTS
@@ -25,6 +27,15 @@ namespace gc {
 
 constexpr long END_MARK = 0;
 
+enum class ObjectKind { RECORD, ARRAY, DATA };
+
+/**
+ * Visitor of ForEachLive(): kind, size of the body in bytes, and the pointer
+ * bitmap of a record (null for other objects).
+ */
+using LiveVisitor =
+    std::function<void(ObjectKind kind, uint64_t size, const uint64_t *)>;
+
 class TigerHeap {
 public:
   /**
@@ -61,6 +72,13 @@ public:
    */
   virtual uint64_t MaxFree() const = 0;
 
+  /**
+   * Free bytes in total and the longest free block, for statistics only.
+   */
+  virtual void FreeSpace(uint64_t *free, uint64_t *max_free) const {
+    *free = *max_free = MaxFree();
+  }
+
   /**
    * Initialize your heap.
    * @param size size of your heap in bytes.
@@ -71,14 +89,54 @@ public:
    * Do Garbage collection!
    * Hint: Though we do not suggest you implementing a Generational-GC due to
    * limited time, if you are willing to try it, add a function named YoungGC,
-   * this will be treated as FullGC by default.
+   * this will be treated as FullGC by default. See GenerationalHeap.
    */
   virtual void GC() = 0;
-  virtual char *AllocRecord(uint64_t size, unsigned char *descriptor,
+  /**
+   * Allocate a record.
+   * @param descriptor pointer bitmap, bit i of word i / 64 is set if field
+   * i holds a heap pointer.
+   * @param descriptor_size number of fields.
+   */
+  virtual char *AllocRecord(uint64_t size, const uint64_t *descriptor,
                             uint64_t descriptor_size) = 0;
-  virtual char *AllocArray(uint64_t size) = 0;
+
+  /**
+   * Allocate an array.
+   * @param pointers whether the elements are heap pointers (or nil), only
+   * those arrays are traced.
+   */
+  virtual char *AllocArray(uint64_t size, bool pointers) = 0;
+
+  /**
+   * Whether AllocArray() of size bytes returns memory that is already zero,
+   * so that an array of 0 or nil needs no fill.
+   */
+  virtual bool ZeroFilled(uint64_t size) const { return false; }
+
+  /**
+   * Allocate a string, which holds no pointers.
+   * @param size size of the length and the characters, in bytes.
+   */
+  virtual char *AllocString(uint64_t size) = 0;
+
+  /**
+   * Visit every object the last GC() kept, only valid right after it.
+   * Objects a conservative collector retains count as live.
+   */
+  virtual void ForEachLive(const LiveVisitor &visit) const = 0;
   static constexpr uint64_t WORD_SIZE = 8;
   uint64_t *stack = nullptr;
+  // slots of runtime functions holding heap pointers across a GC(),
+  // collectors treat them as roots and may update them
+  std::vector<uint64_t *> runtime_roots;
+  // slots holding object starts that do not keep their object alive,
+  // collectors set them to 0 when the object dies and update them when it
+  // moves
+  std::vector<uint64_t *> weak_roots;
+  // set to make the next GC() collect the whole heap, for heaps that may
+  // otherwise collect only part of it
+  bool full_gc = false;
 };
 
 } // namespace gc
@@ -0,0 +1,102 @@
+#include "heap_histogram.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace gc {
+
+namespace {
+template <typename Map>
+std::vector<typename Map::const_pointer> ByBytes(const Map &map) {
+  std::vector<typename Map::const_pointer> sorted;
+  for (const auto &entry : map)
+    sorted.push_back(&entry);
+  std::stable_sort(sorted.begin(), sorted.end(), [](auto a, auto b) {
+    return a->second.bytes > b->second.bytes;
+  });
+  return sorted;
+}
+} // namespace
+
+HeapHistogram::HeapHistogram(const TigerHeap &heap) {
+  heap.ForEachLive(
+      [this](const ObjectKind kind, const uint64_t size,
+             const uint64_t *descriptor) { Add(kind, size, descriptor); });
+}
+
+void HeapHistogram::Add(const ObjectKind kind, const uint64_t size,
+                        const uint64_t *descriptor) {
+  Entry *entry = nullptr;
+  switch (kind) {
+  case ObjectKind::RECORD: {
+    // the name follows the bitmap, which has a word per 64 fields
+    const uint64_t fields = size / TigerHeap::WORD_SIZE;
+    const uint64_t words = std::max<uint64_t>((fields + 63) / 64, 1);
+    entry = &records_[reinterpret_cast<const char *>(descriptor + words)];
+    break;
+  }
+  case ObjectKind::ARRAY:
+    entry = &arrays_[SizeClass(size)];
+    break;
+  case ObjectKind::DATA:
+    entry = &data_[SizeClass(size)];
+    break;
+  }
+  ++entry->count;
+  entry->bytes += size;
+  ++total_.count;
+  total_.bytes += size;
+}
+
+uint64_t HeapHistogram::SizeClass(const uint64_t size) {
+  uint64_t size_class = 1;
+  while (size_class < size)
+    size_class <<= 1;
+  return size_class;
+}
+
+void HeapHistogram::WriteText(FILE *out) const {
+  fprintf(out, "live heap: %lu objects, %lu bytes\n", total_.count,
+          total_.bytes);
+  fprintf(out, "records by type:\n");
+  for (const auto entry : ByBytes(records_))
+    fprintf(out, "  %10lu %12lu  %s\n", entry->second.count,
+            entry->second.bytes, entry->first.data());
+  fprintf(out, "pointer arrays by size:\n");
+  for (const auto &[size_class, entry] : arrays_)
+    fprintf(out, "  %10lu %12lu  <= %lu bytes\n", entry.count, entry.bytes,
+            size_class);
+  fprintf(out, "int arrays and strings by size:\n");
+  for (const auto &[size_class, entry] : data_)
+    fprintf(out, "  %10lu %12lu  <= %lu bytes\n", entry.count, entry.bytes,
+            size_class);
+}
+
+void HeapHistogram::WriteJson(FILE *out) const {
+  fprintf(out, "{\n  \"objects\": %lu,\n  \"bytes\": %lu,\n  \"records\": [",
+          total_.count, total_.bytes);
+  const char *separator = "\n";
+  for (const auto entry : ByBytes(records_)) {
+    // type names are tiger identifiers, nothing to escape
+    fprintf(out, "%s    {\"type\": \"%s\", \"count\": %lu, \"bytes\": %lu}",
+            separator, entry->first.data(), entry->second.count,
+            entry->second.bytes);
+    separator = ",\n";
+  }
+  const auto write_classes = [out](const char *name,
+                                   const std::map<uint64_t, Entry> &classes) {
+    fprintf(out, "\n  ],\n  \"%s\": [", name);
+    const char *separator = "\n";
+    for (const auto &[size_class, entry] : classes) {
+      fprintf(out,
+              "%s    {\"max_size\": %lu, \"count\": %lu, \"bytes\": %lu}",
+              separator, size_class, entry.count, entry.bytes);
+      separator = ",\n";
+    }
+  };
+  write_classes("arrays", arrays_);
+  write_classes("data", data_);
+  fprintf(out, "\n  ]\n}\n");
+}
+
+} // namespace gc
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "heap.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+
+namespace gc {
+
+/**
+ * Live objects of a heap by record type and by array size class.
+ *
+ * Records are named by the type name the compiler stores after the
+ * descriptor bitmap (frame::DescriptorFrag). Pointer arrays and data
+ * objects, which are int arrays and strings, are counted per power of two
+ * of their size in bytes.
+ */
+class HeapHistogram {
+public:
+  /**
+   * Count the objects heap.ForEachLive() visits.
+   */
+  explicit HeapHistogram(const TigerHeap &heap);
+
+  void WriteText(FILE *out) const;
+  void WriteJson(FILE *out) const;
+
+private:
+  struct Entry {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+  };
+
+  void Add(ObjectKind kind, uint64_t size, const uint64_t *descriptor);
+
+  /**
+   * Smallest power of two at least size.
+   */
+  static uint64_t SizeClass(uint64_t size);
+
+  Entry total_;
+  // by type name
+  std::map<std::string, Entry> records_;
+  // by size class
+  std::map<uint64_t, Entry> arrays_;
+  std::map<uint64_t, Entry> data_;
+};
+
+} // namespace gc
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace gc {
+
+/**
+ * Objects too big for the free lists, each in pages mapped for it alone.
+ * They are never moved, and the pages of a dead one go straight back to
+ * the OS. The space only knows blocks, the owning heap lays out the header
+ * and the object inside them and decides which ones are marked.
+ */
+class LargeObjectSpace {
+public:
+  /**
+   * Map a block of at least size bytes.
+   * @return start of the block, nullptr if mmap fails
+   */
+  char *Alloc(const uint64_t size) {
+    static const uint64_t page = sysconf(_SC_PAGESIZE);
+    const uint64_t mapped = (size + page - 1) & ~(page - 1);
+    void *block = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+      perror("mmap");
+      return nullptr;
+    }
+    const auto start = reinterpret_cast<uint64_t>(block);
+    blocks_.emplace(start, Block{size, mapped, 0});
+    used_ += size;
+    UpdateBounds();
+    return static_cast<char *>(block);
+  }
+
+  /**
+   * Start of the block containing x, 0 if x is in none.
+   */
+  uint64_t Find(const uint64_t x) const {
+    if (x < low_ || x >= high_)
+      return 0;
+    auto iter = blocks_.upper_bound(x);
+    if (iter == blocks_.begin())
+      return 0;
+    --iter;
+    if (x >= iter->first + iter->second.size)
+      return 0;
+    return iter->first;
+  }
+
+  /**
+   * Mark the block at start.
+   * @param atomic whether other threads may mark at the same time
+   * @return false if it was already marked
+   */
+  bool Mark(const uint64_t start, const bool atomic) {
+    uint64_t &marked = blocks_.find(start)->second.marked;
+    if (atomic)
+      return __atomic_exchange_n(&marked, 1, __ATOMIC_RELAXED) == 0;
+    if (marked)
+      return false;
+    marked = 1;
+    return true;
+  }
+
+  bool Marked(const uint64_t start) const {
+    return blocks_.find(start)->second.marked;
+  }
+
+  /**
+   * Unmap the blocks that are not marked and clear the marks of the rest.
+   * @return bytes freed
+   */
+  uint64_t Sweep() {
+    uint64_t freed = 0;
+    for (auto iter = blocks_.begin(); iter != blocks_.end();) {
+      if (iter->second.marked) {
+        iter->second.marked = 0;
+        ++iter;
+        continue;
+      }
+      munmap(reinterpret_cast<void *>(iter->first), iter->second.mapped);
+      freed += iter->second.size;
+      iter = blocks_.erase(iter);
+    }
+    used_ -= freed;
+    UpdateBounds();
+    return freed;
+  }
+
+  /**
+   * Call f with the start of every block.
+   */
+  template <typename F> void ForEach(F f) const {
+    for (const auto &block : blocks_)
+      f(block.first);
+  }
+
+  uint64_t Used() const { return used_; }
+
+private:
+  struct Block {
+    // bytes asked for and bytes mapped
+    uint64_t size;
+    uint64_t mapped;
+    uint64_t marked;
+  };
+
+  void UpdateBounds() {
+    if (blocks_.empty()) {
+      low_ = high_ = 0;
+      return;
+    }
+    low_ = blocks_.begin()->first;
+    high_ = blocks_.rbegin()->first + blocks_.rbegin()->second.size;
+  }
+
+  std::map<uint64_t, Block> blocks_;
+  // every block lies in [low_, high_), most words are rejected by that
+  uint64_t low_ = 0;
+  uint64_t high_ = 0;
+  uint64_t used_ = 0;
+};
+
+} // namespace gc
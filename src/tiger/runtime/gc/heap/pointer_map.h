@@ -0,0 +1,167 @@
+#pragma once
+
+#include "heap.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+namespace gc {
+class PointerMapNode {
+public:
+  uint64_t key = 0;
+  uint64_t frame_size = 0;
+  uint64_t in_main = 0;
+  // index of the frame offsets holding live pointers in the shared offset
+  // sets, and of every pointer slot of the frame
+  uint64_t offsets = 0;
+  uint64_t frame_offsets = 0;
+  PointerMapNode() = default;
+};
+class PointerMapManager {
+  // sorted by key (the return address) for binary search
+  std::vector<PointerMapNode> pointer_map_;
+  std::vector<std::vector<int64_t>> offset_sets_;
+
+  static uint64_t ReadQuad(const uint8_t **cur) {
+    uint64_t value;
+    memcpy(&value, *cur, sizeof(value));
+    *cur += sizeof(value);
+    return value;
+  }
+  static uint64_t ReadULEB(const uint8_t **cur) {
+    uint64_t value = 0;
+    for (uint64_t shift = 0;; shift += 7) {
+      const uint8_t byte = *(*cur)++;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+  }
+  static int64_t ReadSLEB(const uint8_t **cur) {
+    uint64_t value = 0;
+    uint64_t shift = 0;
+    uint8_t byte;
+    do {
+      byte = *(*cur)++;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    if (shift < 64 && (byte & 0x40))
+      value |= ~0ull << shift;
+    return static_cast<int64_t>(value);
+  }
+
+public:
+  PointerMapManager() { Init(); }
+
+  /**
+   * Decode the table gc::PointerMapList::Print emits.
+   */
+  void Init() {
+    const auto *cur = reinterpret_cast<const uint8_t *>(&GLOBAL_GC_ROOTS);
+    const uint64_t functions = ReadQuad(&cur);
+    for (uint64_t f = 0; f < functions; ++f) {
+      uint64_t key = ReadQuad(&cur);
+      const uint64_t frame_size = ReadULEB(&cur);
+      const uint64_t in_main = ReadULEB(&cur);
+      const uint64_t first_set = offset_sets_.size();
+      const uint64_t sets = ReadULEB(&cur);
+      for (uint64_t i = 0; i < sets; ++i) {
+        std::vector<int64_t> offsets(ReadULEB(&cur));
+        for (auto &offset : offsets)
+          offset = ReadSLEB(&cur);
+        offset_sets_.emplace_back(std::move(offsets));
+      }
+      const uint64_t sites = ReadULEB(&cur);
+      for (uint64_t i = 0; i < sites; ++i) {
+        PointerMapNode node;
+        key += ReadULEB(&cur);
+        node.key = key;
+        node.frame_size = frame_size;
+        node.in_main = in_main;
+        node.offsets = first_set + ReadULEB(&cur);
+        node.frame_offsets = first_set;
+        pointer_map_.emplace_back(node);
+      }
+    }
+    // the compiler emits the sites in code order, but the linker may not
+    // keep the functions in that order
+    const auto by_key = [](const PointerMapNode &a, const PointerMapNode &b) {
+      return a.key < b.key;
+    };
+    if (!std::is_sorted(pointer_map_.begin(), pointer_map_.end(), by_key))
+      std::sort(pointer_map_.begin(), pointer_map_.end(), by_key);
+  }
+
+  /**
+   * Find the pointer map of the call site returning to ret_add.
+   * @return nullptr if ret_add is not a call site of tiger code
+   */
+  const PointerMapNode *Find(const uint64_t ret_add) const {
+    const auto iter = std::lower_bound(
+        pointer_map_.begin(), pointer_map_.end(), ret_add,
+        [](const PointerMapNode &pm, uint64_t key) { return pm.key < key; });
+    if (iter == pointer_map_.end() || iter->key != ret_add)
+      return nullptr;
+    return &*iter;
+  }
+
+  std::vector<uint64_t> GetRootAddress(uint64_t *sp) {
+    std::vector<uint64_t> address;
+    for (const auto slot : GetRootSlots(sp)) {
+      address.emplace_back(*slot);
+    }
+    return address;
+  }
+
+  /**
+   * Walk the tiger stack and collect the stack slots holding heap pointers,
+   * so that a moving collector can update them in place.
+   * @param sp address of the return address pushed by the first tiger frame
+   * @param stack_end if not null, set to the end of the tigermain frame
+   * @param dead_slots if not null, gets the pointer slots that are dead at
+   * the call, which hold nothing to trace even conservatively
+   * @return addresses of the root slots
+   */
+  std::vector<uint64_t *> GetRootSlots(uint64_t *sp,
+                                       uint64_t **stack_end = nullptr,
+                                       std::vector<uint64_t *> *dead_slots =
+                                           nullptr) {
+    std::vector<uint64_t *> slots;
+    bool in_main = false;
+    while (!in_main) {
+      const PointerMapNode *pm = Find(*sp);
+      if (!pm) {
+        fprintf(stderr, "no pointer map for return address %lx\n", *sp);
+        break;
+      }
+      const auto frame_end = reinterpret_cast<int64_t>(sp + 1) +
+                             static_cast<int64_t>(pm->frame_size);
+      const auto &live = offset_sets_[pm->offsets];
+      for (const int64_t offset : live) {
+        slots.emplace_back(reinterpret_cast<uint64_t *>(frame_end + offset));
+      }
+      if (dead_slots) {
+        // both sets are sorted
+        const auto &all = offset_sets_[pm->frame_offsets];
+        std::vector<int64_t> dead;
+        std::set_difference(all.begin(), all.end(), live.begin(), live.end(),
+                            std::back_inserter(dead));
+        for (const int64_t offset : dead) {
+          dead_slots->emplace_back(
+              reinterpret_cast<uint64_t *>(frame_end + offset));
+        }
+      }
+      sp += (pm->frame_size / 8 + 1);
+      in_main = pm->in_main;
+    }
+    if (stack_end)
+      *stack_end = sp;
+    return slots;
+  }
+};
+
+} // namespace gc
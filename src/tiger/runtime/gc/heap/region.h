@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/mman.h>
+
+namespace gc {
+
+/**
+ * A contiguous range of address space reserved up front with mmap, whose
+ * prefix is committed (made readable and writable) on demand. Growing the
+ * heap therefore never moves it.
+ */
+class Region {
+public:
+  /**
+   * Reserve reserve bytes of address space and commit the first commit.
+   * @param huge_pages advise the kernel to back the region with
+   * transparent huge pages
+   */
+  bool Reserve(uint64_t reserve, uint64_t commit, bool huge_pages) {
+    void *start = mmap(nullptr, reserve, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED) {
+      perror("mmap");
+      return false;
+    }
+    start_ = static_cast<char *>(start);
+    reserved_ = reserve;
+    if (huge_pages) {
+#ifdef MADV_HUGEPAGE
+      madvise(start_, reserved_, MADV_HUGEPAGE);
+#endif
+    }
+    return Commit(commit);
+  }
+
+  /**
+   * Commit the region up to size bytes from its start.
+   */
+  bool Commit(uint64_t size) {
+    if (size <= committed_)
+      return true;
+    if (size > reserved_)
+      return false;
+    if (mprotect(start_ + committed_, size - committed_,
+                 PROT_READ | PROT_WRITE) != 0) {
+      perror("mprotect");
+      return false;
+    }
+    committed_ = size;
+    return true;
+  }
+
+  char *Start() const { return start_; }
+  uint64_t Committed() const { return committed_; }
+  uint64_t Reserved() const { return reserved_; }
+
+private:
+  char *start_ = nullptr;
+  uint64_t reserved_ = 0;
+  uint64_t committed_ = 0;
+};
+
+} // namespace gc
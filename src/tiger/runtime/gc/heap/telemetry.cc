@@ -0,0 +1,106 @@
+#include "telemetry.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace gc {
+
+Telemetry telemetry;
+
+namespace {
+uint64_t Clock() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+void Telemetry::Initialize() {
+  const char *stats = getenv("TIGER_GC_STATS");
+  summary_ = stats && strcmp(stats, "0") != 0;
+  trace_path_ = getenv("TIGER_GC_TRACE");
+  enabled_ = summary_ || trace_path_;
+  if (!enabled_)
+    return;
+  start_ = Clock();
+  atexit(Exit);
+}
+
+uint64_t Telemetry::Now() const { return Clock() - start_; }
+
+void Telemetry::Phase(const char *name, const uint64_t begin,
+                      const uint64_t end) {
+  if (trace_path_)
+    events_.push_back({name, begin, end});
+}
+
+void Telemetry::Collection(const uint64_t begin, const uint64_t end,
+                           const uint64_t free, const uint64_t max_free) {
+  const uint64_t pause = end - begin;
+  ++collections_;
+  pause_total_ += pause;
+  if (pause > pause_max_)
+    pause_max_ = pause;
+  int bucket = 0;
+  for (uint64_t us = pause / 1000; us > 1 && bucket < BUCKETS - 1; us >>= 1)
+    ++bucket;
+  ++pauses_[bucket];
+  free_ = free;
+  max_free_ = max_free;
+  Phase("gc", begin, end);
+}
+
+void Telemetry::Exit() {
+  fflush(stdout);
+  if (telemetry.summary_)
+    telemetry.Report(stderr);
+  if (telemetry.trace_path_)
+    telemetry.WriteTrace();
+}
+
+void Telemetry::Report(FILE *out) const {
+  const uint64_t total = Now();
+  const uint64_t mutator = total - pause_total_;
+  fprintf(out, "gc: %lu collections, %.3f ms paused of %.3f ms total\n",
+          collections_, pause_total_ / 1e6, total / 1e6);
+  if (collections_) {
+    fprintf(out, "gc: pause mean %.3f ms, max %.3f ms\n",
+            pause_total_ / 1e6 / collections_, pause_max_ / 1e6);
+    for (int i = 0; i < BUCKETS; ++i) {
+      if (pauses_[i])
+        fprintf(out, "gc:   < %8lu us: %lu\n", 2ul << i, pauses_[i]);
+    }
+  }
+  fprintf(out, "gc: %lu bytes allocated, %.1f MB/s of mutator time\n",
+          allocated_, mutator ? allocated_ * 1e3 / mutator : 0.0);
+  fprintf(out, "gc: %lu bytes marked, %lu bytes swept\n", marked_, swept_);
+  if (collections_) {
+    fprintf(out,
+            "gc: after the last collection %lu bytes free, largest block "
+            "%lu bytes, fragmentation %.1f%%\n",
+            free_, max_free_,
+            free_ ? 100.0 * (free_ - max_free_) / free_ : 0.0);
+  }
+}
+
+void Telemetry::WriteTrace() const {
+  FILE *out = fopen(trace_path_, "w");
+  if (!out) {
+    perror(trace_path_);
+    return;
+  }
+  fprintf(out, "{\"traceEvents\":[");
+  for (uint64_t i = 0; i < events_.size(); ++i) {
+    const Event &event = events_[i];
+    fprintf(out,
+            "%s\n{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"X\",\"pid\":1,"
+            "\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+            i ? "," : "", event.name, event.begin / 1e3,
+            (event.end - event.begin) / 1e3);
+  }
+  fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(out);
+}
+
+} // namespace gc
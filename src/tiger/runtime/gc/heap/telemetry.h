@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace gc {
+
+/**
+ * GC statistics for every heap.
+ *
+ * TIGER_GC_STATS=1 prints a summary to stderr at exit: collection count,
+ * pause histogram, bytes marked and swept, allocation rate and
+ * fragmentation. TIGER_GC_TRACE=<file> writes the GC phases as Chrome
+ * trace events (chrome://tracing, Perfetto). When neither is set, callers
+ * only test Enabled() and record nothing.
+ */
+class Telemetry {
+public:
+  /**
+   * Read the environment, called once by main.
+   */
+  void Initialize();
+
+  bool Enabled() const { return enabled_; }
+
+  /**
+   * Nanoseconds since Initialize().
+   */
+  uint64_t Now() const;
+
+  void Allocated(uint64_t bytes) { allocated_ += bytes; }
+  void Marked(uint64_t bytes) { marked_ += bytes; }
+  void Swept(uint64_t bytes) { swept_ += bytes; }
+
+  /**
+   * A phase of a collection, only kept for the trace.
+   */
+  void Phase(const char *name, uint64_t begin, uint64_t end);
+
+  /**
+   * A whole collection as seen by the mutator, and the heap after it.
+   */
+  void Collection(uint64_t begin, uint64_t end, uint64_t free,
+                  uint64_t max_free);
+
+private:
+  static constexpr int BUCKETS = 24;
+
+  struct Event {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+  };
+
+  // atexit handler, it runs on the stack of whoever called exit(), which
+  // tiger code does not keep aligned
+  __attribute__((force_align_arg_pointer)) static void Exit();
+  void Report(FILE *out) const;
+  void WriteTrace() const;
+
+  bool enabled_ = false;
+  bool summary_ = false;
+  const char *trace_path_ = nullptr;
+  uint64_t start_ = 0;
+
+  uint64_t collections_ = 0;
+  uint64_t pause_total_ = 0;
+  uint64_t pause_max_ = 0;
+  // pauses of [2^i, 2^(i+1)) microseconds
+  uint64_t pauses_[BUCKETS] = {};
+  uint64_t allocated_ = 0;
+  uint64_t marked_ = 0;
+  uint64_t swept_ = 0;
+  // free bytes and the longest free block after the last collection
+  uint64_t free_ = 0;
+  uint64_t max_free_ = 0;
+  std::vector<Event> events_;
+};
+
+extern Telemetry telemetry;
+
+} // namespace gc
@@ -2,7 +2,11 @@
 #define TIGER_RUNTIME_GC_ROOTS_H
 
 #include "tiger/frame/frame.h"
+#include "tiger/liveness/flowgraph.h"
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <vector>
 
@@ -13,50 +17,111 @@
 namespace gc {
 
 const std::string GC_ROOTS = "GLOBAL_GC_ROOTS";
+// Must agree with gc::CardTable in the runtime
+const std::string CARD_TABLE = "tiger_card_table";
+const std::string CARD_MASK = "tiger_card_mask";
+constexpr int CARD_SHIFT = 9;
+// Must agree with the record header and LARGE_SIZE of gc::CopyingHeap
+const std::string HEAP_TOP = "tiger_heap_top";
+const std::string HEAP_LIMIT = "tiger_heap_limit";
+constexpr int HEADER_SIZE = 8;
+constexpr int DESCRIPTOR_SHIFT = 16;
+constexpr int FIELD_COUNT_SHIFT = 3;
+constexpr int INLINE_ALLOC_MAX = 1024;
 
+// Runtime functions that never collect. Their call sites are never on the
+// stack during a collection, so they get no pointer map.
+const std::set<std::string> NON_ALLOCATING = {
+    "print", "printi", "flush",   "ord",     "chr",  "size",
+    "not",   "exit",   "getchar", "MaxFree", "Used", "string_equal"};
+
+/**
+ * Pointer map of one call site.
+ */
 class PointerMap {
 public:
-  std::string label;
-  std::string next_label;
   std::string ret_add;
-  std::string frame_size;
-  bool in_main;
-  std::vector<std::string> offsets;
-  std::string end;
+  // index of the frame offsets holding pointers in the offset sets of the
+  // function
+  uint64_t offset_set = 0;
 
   PointerMap() = default;
 };
 
+/**
+ * Pointer maps of the call sites of one function, which share a few sets of
+ * frame offsets.
+ */
+class FunctionPointerMaps {
+public:
+  std::string label;
+  std::string frame_size;
+  bool in_main = false;
+  std::vector<std::vector<int64_t>> offset_sets;
+  std::vector<PointerMap> sites;
+
+  /**
+   * Index of offsets in offset_sets, added if it is not there yet.
+   */
+  uint64_t AddOffsetSet(std::vector<int64_t> offsets) {
+    std::sort(offsets.begin(), offsets.end());
+    const auto iter = std::find(offset_sets.begin(), offset_sets.end(), offsets);
+    if (iter != offset_sets.end())
+      return iter - offset_sets.begin();
+    offset_sets.emplace_back(std::move(offsets));
+    return offset_sets.size() - 1;
+  }
+};
+
+/**
+ * The GLOBAL_GC_ROOTS table, read by gc::PointerMapManager. It starts with
+ * the number of functions as a .quad, then for every function:
+ *   .quad    function label
+ *   .uleb128 frame size, whether it is tigermain
+ *   .uleb128 number of offset sets, then every set as
+ *            .uleb128 count followed by .sleb128 offsets. The first set
+ *            holds every pointer slot of the frame, the slots a site
+ *            leaves out are dead there and hold nothing to trace
+ *   .uleb128 number of call sites, then every site as
+ *            .uleb128 distance from the previous return address (from the
+ *            function label for the first) and .uleb128 offset set index
+ * Functions and sites come in code order, so return addresses ascend.
+ */
 class PointerMapList {
-  std::vector<PointerMap> roots;
+  std::vector<FunctionPointerMaps> functions;
 
 public:
   PointerMapList() = default;
-  std::vector<PointerMap> *GetRoots() { return &roots; }
-  void AddRoot(PointerMap &content) { roots.emplace_back(content); }
-  void AddRoots(PointerMapList *content) {
-    const auto vec = content->GetRoots();
-    roots.insert(roots.end(), vec->begin(), vec->end());
+  std::vector<FunctionPointerMaps> *GetFunctions() { return &functions; }
+  void AddFunction(FunctionPointerMaps content) {
+    functions.emplace_back(std::move(content));
   }
-  void UpdateNext() {
-    auto iter = roots.begin();
-    for (auto next = iter + 1; next != roots.end(); ++iter, ++next) {
-      iter->next_label = next->label;
-    }
+  void AddRoots(PointerMapList *content) {
+    const auto vec = content->GetFunctions();
+    functions.insert(functions.end(), vec->begin(), vec->end());
   }
   void Print(FILE *out) const {
     std::stringstream ss;
-    for (const auto &[label, next_label, ret_add, frame_size, in_main, offsets,
-                      end] : roots) {
-      ss << label << ":\n";
-      ss << ".quad " << next_label << "\n";
-      ss << ".quad " << ret_add << "\n";
-      ss << ".quad " << frame_size << "\n";
-      ss << ".quad " << in_main << "\n";
-      for (const auto &offset : offsets) {
-        ss << ".quad " << offset << "\n";
+    ss << ".quad " << functions.size() << "\n";
+    for (const auto &[label, frame_size, in_main, offset_sets, sites] :
+         functions) {
+      ss << ".quad " << label << "\n";
+      ss << ".uleb128 " << frame_size << "\n";
+      ss << ".uleb128 " << in_main << "\n";
+      ss << ".uleb128 " << offset_sets.size() << "\n";
+      for (const auto &offsets : offset_sets) {
+        ss << ".uleb128 " << offsets.size() << "\n";
+        for (const auto offset : offsets) {
+          ss << ".sleb128 " << offset << "\n";
+        }
+      }
+      ss << ".uleb128 " << sites.size() << "\n";
+      std::string prev = label;
+      for (const auto &site : sites) {
+        ss << ".uleb128 " << site.ret_add << "-" << prev << "\n";
+        ss << ".uleb128 " << site.offset_set << "\n";
+        prev = site.ret_add;
       }
-      ss << ".quad " << end << "\n";
     }
     const auto str = ss.str();
     fprintf(out, "%s", str.c_str());
@@ -76,34 +141,103 @@ public:
   }
   PointerMapList *GetList() const { return pointer_map_list_; }
   void FillList() {
-    bool reted = false;
+    FunctionPointerMaps maps;
+    maps.label = frame_->GetLabel();
+    maps.frame_size = frame_->name_->Name() + "_framesize";
+    maps.in_main = frame_->name_->Name() == "tigermain";
+    maps.AddOffsetSet(frame_->GetOffsets());
+    const auto live_in = SlotLiveness(maps.frame_size);
+    // the label codegen puts after a call is its return address
+    bool after_call = false;
     for (const auto &instr : instr_list_->GetList()) {
-      if (!reted && typeid(*instr) == typeid(assem::OperInstr)) {
-        if (auto content = static_cast<assem::OperInstr *>(instr)->assem_;
-            content.find("callq") != content.npos) {
-          continue;
+      if (typeid(*instr) == typeid(assem::OperInstr)) {
+        const auto &content = static_cast<assem::OperInstr *>(instr)->assem_;
+        if (content.rfind("callq ", 0) == 0) {
+          after_call = !NON_ALLOCATING.count(content.substr(6));
         }
-        reted = true;
         continue;
       }
-      if (reted && typeid(*instr) == typeid(assem::LabelInstr)) {
+      if (after_call && typeid(*instr) == typeid(assem::LabelInstr)) {
+        // nested functions may read the escaping slots at any time
+        std::vector<int64_t> offsets = frame_->GetEscapingOffsets();
+        const auto &live = live_in.at(instr);
+        offsets.insert(offsets.end(), live.begin(), live.end());
         PointerMap pmap;
-        pmap.ret_add = dynamic_cast<assem::LabelInstr *>(instr)->label_->Name();
-        pmap.label = "L" + pmap.ret_add;
-        pmap.frame_size = frame_->name_->Name() + "_framesize";
-        pmap.next_label = "0";
-        if (frame_->name_->Name() == "tigermain") {
-          pmap.in_main = true;
-        } else {
-          pmap.in_main = false;
+        pmap.ret_add = static_cast<assem::LabelInstr *>(instr)->label_->Name();
+        pmap.offset_set = maps.AddOffsetSet(std::move(offsets));
+        maps.sites.emplace_back(pmap);
+      }
+      after_call = false;
+    }
+    pointer_map_list_->AddFunction(std::move(maps));
+  }
+
+private:
+  /**
+   * Recognize the frame slot loads and stores codegen emits, which address
+   * the slot as frame_size+offset off the stack pointer.
+   * @param write set to whether the slot is written
+   */
+  static bool SlotAccess(const assem::Instr *instr,
+                         const std::string &frame_size, int64_t *offset,
+                         bool *write) {
+    if (typeid(*instr) != typeid(assem::OperInstr))
+      return false;
+    const auto &content = static_cast<const assem::OperInstr *>(instr)->assem_;
+    const auto pos = content.find(frame_size);
+    const auto sign = pos + frame_size.size();
+    if (pos == content.npos || sign >= content.size() ||
+        (content[sign] != '-' && content[sign] != '+'))
+      return false;
+    *offset = std::stoll(content.substr(sign));
+    *write = content.find(',') < pos;
+    return true;
+  }
+
+  /**
+   * Liveness of the pointer slots only this function can read, computed
+   * backwards over the flow graph like live::LiveGraphFactory does for
+   * temporaries.
+   * @return the slots live on entry to every instruction
+   */
+  std::map<assem::Instr *, std::set<int64_t>>
+  SlotLiveness(const std::string &frame_size) const {
+    std::set<int64_t> local;
+    for (const int64_t offset : frame_->GetOffsets())
+      local.insert(offset);
+    for (const int64_t offset : frame_->GetEscapingOffsets())
+      local.erase(offset);
+
+    fg::FlowGraphFactory flow_graph(instr_list_);
+    flow_graph.AssemFlowGraph();
+    const auto &nodes = flow_graph.GetFlowGraph()->Nodes()->GetList();
+    std::map<assem::Instr *, std::set<int64_t>> live_in;
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto iter = nodes.rbegin(); iter != nodes.rend(); ++iter) {
+        std::set<int64_t> live;
+        for (const auto &succ : (*iter)->Succ()->GetList()) {
+          const auto &succ_in = live_in[succ->NodeInfo()];
+          live.insert(succ_in.begin(), succ_in.end());
+        }
+        int64_t offset;
+        bool write;
+        if (SlotAccess((*iter)->NodeInfo(), frame_size, &offset, &write) &&
+            local.count(offset)) {
+          if (write)
+            live.erase(offset);
+          else
+            live.insert(offset);
         }
-        for (const int64_t offset : frame_->GetOffsets()) {
-          pmap.offsets.emplace_back(std::to_string(offset));
+        auto &in = live_in[(*iter)->NodeInfo()];
+        if (live != in) {
+          in = std::move(live);
+          changed = true;
         }
-        pmap.end = "-1";
-        pointer_map_list_->AddRoot(pmap);
       }
     }
+    return live_in;
   }
 };
 
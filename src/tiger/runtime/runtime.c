@@ -4,6 +4,16 @@
 
 extern int tigermain();
 
+// The compiler emits a card-marking write barrier for pointer stores. There
+// is no collector here, so every store marks the same card.
+long tiger_card;
+long *tiger_card_table = &tiger_card;
+long tiger_card_mask = 0;
+// Compiled code allocates records inline while tiger_heap_top has room
+// before tiger_heap_limit. With both null it always calls alloc_record.
+char *tiger_heap_top = 0;
+char *tiger_heap_limit = 0;
+
 // seven arguments testcase
 int sum_seven(int v1, int v2, int v3, int v4, int v5, int v6, int v7) {
   return v1 + v2 + v3 + v4 + v5 + v6 + v7;
@@ -16,6 +26,9 @@ long *init_array(int size, long init) {
   return a;
 }
 
+// Arrays of records, arrays and strings, only a collector tells them apart
+long *init_pointer_array(int size, long init) { return init_array(size, init); }
+
 int *alloc_record(int size) {
   int i;
   int *p, *a;
@@ -117,4 +130,20 @@ struct string *__wrap_getchar() {
     return &empty;
   else
     return consts + i;
-}
\ No newline at end of file
+}
+
+// The next line of stdin including its newline, "" at end of input
+struct string *readline() {
+  int n = 0, cap = 64, c;
+  struct string *t = (struct string *)malloc(sizeof(int) + cap);
+  while ((c = getc(stdin)) != EOF) {
+    if (n == cap) {
+      cap *= 2;
+      t = (struct string *)realloc(t, sizeof(int) + cap);
+    }
+    t->chars[n++] = c;
+    if (c == '\n') break;
+  }
+  t->length = n;
+  return t;
+}
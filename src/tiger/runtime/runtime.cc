@@ -1,18 +1,44 @@
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
 // Note: change to header file of your implemnted heap!
 // #include "gc/heap/heap.h"
+#include "gc/heap/alloc_profile.h"
+#include "gc/heap/copying_heap.h"
 #include "gc/heap/derived_heap.h"
+#include "gc/heap/generational_heap.h"
+#include "gc/heap/heap_histogram.h"
+#include "gc/heap/telemetry.h"
 
 #ifndef EXTERNC
 #define EXTERNC extern "C"
 #endif
 
+// Initial heap size, the mark-sweep heap grows beyond it
 #define TIGER_HEAP_SIZE (1 << 20)
 
 EXTERNC int tigermain(int);
 gc::TigerHeap *tiger_heap = nullptr;
+// Card table used by the write barrier, set up by the heap
+extern "C" {
+uint64_t *tiger_card_table = nullptr;
+uint64_t tiger_card_mask = 0;
+}
+// Bump pointer for inline record allocation, heaps without one leave both
+// null so that compiled code always calls alloc_record
+extern "C" {
+char *tiger_heap_top = nullptr;
+char *tiger_heap_limit = nullptr;
+}
 
 #define CHECK_HEAP                                                             \
   do {                                                                         \
@@ -43,137 +69,677 @@ EXTERNC uint64_t MaxFree() {
   return tiger_heap->MaxFree();
 }
 
-EXTERNC long *init_array(int size, long init) {
+struct string {
+  int length;
+  unsigned char chars[1];
+};
+
+// Inlined so that GC() is still called from the frame of alloc_record or
+// init_array, which GET_TIGER_STACK relies on
+__attribute__((always_inline)) static inline void CollectGarbage() {
+  const bool profile = gc::alloc_profile.Enabled();
+  if (profile)
+    gc::alloc_profile.AddWeakRoots(tiger_heap->weak_roots);
+  if (!gc::telemetry.Enabled()) {
+    tiger_heap->GC();
+  } else {
+    const uint64_t begin = gc::telemetry.Now();
+    tiger_heap->GC();
+    const uint64_t end = gc::telemetry.Now();
+    uint64_t free, max_free;
+    tiger_heap->FreeSpace(&free, &max_free);
+    gc::telemetry.Collection(begin, end, free, max_free);
+  }
+  if (profile)
+    gc::alloc_profile.Collected(tiger_heap->weak_roots);
+}
+
+// Record an allocation of code compiled with --alloc-profile. Tiger code
+// does not keep the stack aligned, which the hash map may rely on.
+__attribute__((noinline, force_align_arg_pointer)) static void
+ProfileSite(struct string *site, void *object, uint64_t bytes) {
+  gc::alloc_profile.Allocated(
+      site, {reinterpret_cast<char *>(site->chars), (size_t)site->length},
+      reinterpret_cast<uint64_t>(object), bytes);
+}
+
+// Set by SIGUSR1, the next alloc_record or init_array dumps a histogram of
+// the live heap to TIGER_HEAP_DUMP.<pid>.<n>.txt and .json (tiger-heap by
+// default)
+static volatile sig_atomic_t heap_dump_requested = 0;
+
+static void RequestHeapDump(int) { heap_dump_requested = 1; }
+
+__attribute__((noinline, force_align_arg_pointer)) static void
+WriteHeapDump() {
+  static int dumps = 0;
+  const char *base = getenv("TIGER_HEAP_DUMP");
+  if (!base)
+    base = "tiger-heap";
+  const gc::HeapHistogram histogram(*tiger_heap);
+  char path[4096];
+  snprintf(path, sizeof(path), "%s.%d.%d.txt", base, getpid(), dumps);
+  if (FILE *out = fopen(path, "w")) {
+    histogram.WriteText(out);
+    fclose(out);
+  } else {
+    perror(path);
+  }
+  snprintf(path, sizeof(path), "%s.%d.%d.json", base, getpid(), dumps);
+  if (FILE *out = fopen(path, "w")) {
+    histogram.WriteJson(out);
+    fclose(out);
+  } else {
+    perror(path);
+  }
+  ++dumps;
+}
+
+// Collect the whole heap and dump what is left, inlined for the same reason
+// as CollectGarbage()
+__attribute__((always_inline)) static inline void DumpHeap() {
+  heap_dump_requested = 0;
+  tiger_heap->full_gc = true;
+  CollectGarbage();
+  WriteHeapDump();
+}
+
+// Store init to the n words at a. The runtime is built without
+// optimization, so rather than a loop the first FILL_CHUNK words are
+// filled by doubling memcpy() and then copied over the rest, which lets
+// libc pick SSE2/AVX2 stores for the CPU like memset() does for zeros.
+#define FILL_CHUNK 512
+
+static inline void FillWords(long *a, long n, long init) {
+  if (n == 0)
+    return;
+  a[0] = init;
+  for (long filled = 1; filled < n;) {
+    const long m = std::min({filled, (long)FILL_CHUNK, n - filled});
+    memcpy(a + filled, a, m * sizeof(long));
+    filled += m;
+  }
+}
+
+// Arrays of pointers are traced by the collector, arrays of ints are
+// allocated as data and never scanned. site is null unless profiling.
+__attribute__((always_inline)) static inline long *
+InitArray(int size, long init, bool pointers, struct string *site) {
   GET_TIGER_STACK(tiger_heap->stack);
-  int i;
+  // init may be the only reference to a heap object. An int init must not
+  // be a root, collectors treat roots precisely and may rewrite it.
+  if (pointers)
+    tiger_heap->runtime_roots.push_back(reinterpret_cast<uint64_t *>(&init));
+  if (heap_dump_requested)
+    DumpHeap();
   uint64_t allocate_size = size * sizeof(long);
-  long *a = (long *)tiger_heap->AllocArray(allocate_size);
+  if (gc::telemetry.Enabled())
+    gc::telemetry.Allocated(allocate_size);
+  long *a = (long *)tiger_heap->AllocArray(allocate_size, pointers);
   if (!a) {
-    tiger_heap->GC();
-    a = (long *)tiger_heap->AllocArray(allocate_size);
+    CollectGarbage();
+    a = (long *)tiger_heap->AllocArray(allocate_size, pointers);
+  }
+  if (pointers)
+    tiger_heap->runtime_roots.pop_back();
+  if (!a) {
+    fprintf(stderr, "out of memory\n");
+    exit(-1);
   }
-  for (i = 0; i < size; i++)
-    a[i] = init;
+  if (site)
+    ProfileSite(site, a, allocate_size);
+  if (init != 0)
+    FillWords(a, size, init);
+  else if (!tiger_heap->ZeroFilled(allocate_size))
+    memset(a, 0, allocate_size);
   return a;
 }
 
-struct string {
-  int length;
-  unsigned char chars[1];
+EXTERNC long *init_array(int size, long init) {
+  return InitArray(size, init, false, nullptr);
+}
+
+EXTERNC long *init_pointer_array(int size, long init) {
+  return InitArray(size, init, true, nullptr);
+}
+
+EXTERNC long *init_array_site(int size, long init, struct string *site) {
+  return InitArray(size, init, false, site);
+}
+
+EXTERNC long *init_pointer_array_site(int size, long init,
+                                      struct string *site) {
+  return InitArray(size, init, true, site);
+}
+
+// Collect with the caller's strings s and t as roots, which are updated if
+// they move. Callers with a single string pass it twice, but it is rooted
+// once since a collector must not update a slot twice.
+__attribute__((always_inline)) static inline void
+CollectGarbage(struct string **s, struct string **t) {
+  const size_t roots = tiger_heap->runtime_roots.size();
+  tiger_heap->runtime_roots.push_back(reinterpret_cast<uint64_t *>(s));
+  if (t != s)
+    tiger_heap->runtime_roots.push_back(reinterpret_cast<uint64_t *>(t));
+  CollectGarbage();
+  tiger_heap->runtime_roots.resize(roots);
+}
+
+// Allocate a string of length n on the heap. The caller's strings s and t
+// are kept alive, and updated if they move, when this collects.
+__attribute__((always_inline)) static inline struct string *
+AllocString(int n, struct string **s, struct string **t) {
+  const uint64_t size = sizeof(int) + n;
+  if (gc::telemetry.Enabled())
+    gc::telemetry.Allocated(size);
+  auto *str = (struct string *)tiger_heap->AllocString(size);
+  if (!str) {
+    CollectGarbage(s, t);
+    str = (struct string *)tiger_heap->AllocString(size);
+  }
+  if (!str) {
+    fprintf(stderr, "out of memory\n");
+    exit(-1);
+  }
+  str->length = n;
+  return str;
+}
+
+// Pointer bitmap of a record type, emitted by frame::DescriptorFrag
+struct descriptor {
+  uint64_t length;
+  uint64_t bits[1];
 };
 
-EXTERNC int *alloc_record(int size, struct string *s) {
-  int i;
-  int *p, *a;
-  p = a = (int *)tiger_heap->AllocRecord(size, s->chars, s->length);
+// Inlined for the same reason as CollectGarbage(). site is null unless
+// profiling.
+__attribute__((always_inline)) static inline int *
+AllocRecord(int size, struct descriptor *d, struct string *site) {
+  int *a;
+  if (heap_dump_requested)
+    DumpHeap();
+  if (gc::telemetry.Enabled())
+    gc::telemetry.Allocated(size);
+  a = (int *)tiger_heap->AllocRecord(size, d->bits, d->length);
   if (!a) {
-    tiger_heap->GC();
-    p = a = (int *)tiger_heap->AllocRecord(size, s->chars, s->length);
+    CollectGarbage();
+    a = (int *)tiger_heap->AllocRecord(size, d->bits, d->length);
+  }
+  if (!a) {
+    fprintf(stderr, "out of memory\n");
+    exit(-1);
   }
-  for (i = 0; i < size; i += sizeof(int))
-    *p++ = 0;
+  if (site)
+    ProfileSite(site, a, size);
+  memset(a, 0, size);
   return a;
 }
 
+EXTERNC int *alloc_record(int size, struct descriptor *d) {
+  return AllocRecord(size, d, nullptr);
+}
+
+EXTERNC int *alloc_record_site(int size, struct descriptor *d,
+                               struct string *site) {
+  return AllocRecord(size, d, site);
+}
+
+// Results of concat and substring of at least ROPE_MIN characters are rope
+// nodes instead of flat strings: a concat node points to its two halves, a
+// slice to a flat string and an offset into it. Nodes are records, so the
+// heaps trace them, and their kind overlays the length of a flat string
+// with a negative value. Only the runtime reads the characters of a string,
+// and it walks the nodes in place, so that print, ord, size and
+// string_equal still never allocate on the heap.
+#define ROPE_MIN 64
+
+enum { CONCAT = -1, SLICE = -2 };
+
+struct rope {
+  int kind;
+  int length;
+  // the left half or the sliced string
+  struct string *left;
+  union {
+    struct string *right;
+    long offset;
+  };
+};
+
+// Laid out like frame::DescriptorFrag, the name is for heap histograms
+struct rope_descriptor {
+  uint64_t length;
+  uint64_t bits[1];
+  char name[16];
+};
+static struct rope_descriptor concat_descriptor = {3, {0b110}, "string concat"};
+// A concat node that substring flattened keeps this one, its offset is 0
+static struct rope_descriptor slice_descriptor = {3, {0b010}, "string slice"};
+
+static inline struct rope *Rope(struct string *s) {
+  return reinterpret_cast<struct rope *>(s);
+}
+
+static inline int Length(struct string *s) {
+  return s->length >= 0 ? s->length : Rope(s)->length;
+}
+
+// Allocate a rope node, keeping s and t alive like AllocString()
+__attribute__((always_inline)) static inline struct rope *
+AllocRope(int kind, int length, struct string **s, struct string **t) {
+  struct rope_descriptor *d =
+      kind == CONCAT ? &concat_descriptor : &slice_descriptor;
+  const uint64_t size = sizeof(struct rope);
+  if (gc::telemetry.Enabled())
+    gc::telemetry.Allocated(size);
+  auto *r = (struct rope *)tiger_heap->AllocRecord(size, d->bits, d->length);
+  if (!r) {
+    CollectGarbage(s, t);
+    r = (struct rope *)tiger_heap->AllocRecord(size, d->bits, d->length);
+  }
+  if (!r) {
+    fprintf(stderr, "out of memory\n");
+    exit(-1);
+  }
+  r->kind = kind;
+  r->length = length;
+  return r;
+}
+
+// Call f with the characters of s piece by piece, in order, until it
+// returns false. Ropes built by appending grow deeper with every node, so
+// the right halves still to visit are kept on a vector, which needs the
+// aligned stack tiger code does not keep.
+template <typename F>
+__attribute__((noinline, force_align_arg_pointer)) static void
+ForEachPiece(struct string *s, F f) {
+  std::vector<struct string *> rights;
+  for (;;) {
+    bool more;
+    if (s->length >= 0) {
+      more = f(s->chars, s->length);
+    } else if (Rope(s)->kind == CONCAT) {
+      rights.push_back(Rope(s)->right);
+      s = Rope(s)->left;
+      continue;
+    } else {
+      more = f(Rope(s)->left->chars + Rope(s)->offset, Rope(s)->length);
+    }
+    if (!more || rights.empty())
+      return;
+    s = rights.back();
+    rights.pop_back();
+  }
+}
+
+static inline unsigned char CharAt(struct string *s, int i) {
+  while (s->length < 0) {
+    struct rope *r = Rope(s);
+    if (r->kind == SLICE)
+      return r->left->chars[r->offset + i];
+    const int left = Length(r->left);
+    if (i < left) {
+      s = r->left;
+    } else {
+      s = r->right;
+      i -= left;
+    }
+  }
+  return s->chars[i];
+}
+
+// Copy the n characters of s from first on to p
+static inline void CopyChars(unsigned char *p, struct string *s, int first,
+                             int n) {
+  if (s->length >= 0) {
+    memcpy(p, s->chars + first, n);
+    return;
+  }
+  ForEachPiece(s, [&](const unsigned char *piece, int length) {
+    if (first >= length) {
+      first -= length;
+      return true;
+    }
+    const int m = std::min(length - first, n);
+    memcpy(p, piece + first, m);
+    p += m;
+    n -= m;
+    first = 0;
+    return n > 0;
+  });
+}
+
+// Replace the concat node *s by a slice of a flat copy of it, so that
+// slicing it again does not walk the rope
+__attribute__((always_inline)) static inline void Flatten(struct string **s) {
+  const int n = Rope(*s)->length;
+  struct string *flat = AllocString(n, s, s);
+  CopyChars(flat->chars, *s, 0, n);
+  struct rope *r = Rope(*s);
+  r->kind = SLICE;
+  r->left = flat;
+  r->offset = 0;
+  // the node may be older than the copy, mark it like the write barrier
+  tiger_card_table[(reinterpret_cast<uint64_t>(&r->left) >>
+                    gc::CardTable::CARD_SHIFT) &
+                   tiger_card_mask] = 1;
+}
+
+// string_equal() for ropes of the same length
+__attribute__((noinline, force_align_arg_pointer)) static bool
+RopeEqual(struct string *s, struct string *t) {
+  std::vector<std::pair<const unsigned char *, int>> pieces;
+  ForEachPiece(t, [&](const unsigned char *piece, int length) {
+    pieces.emplace_back(piece, length);
+    return true;
+  });
+  size_t i = 0;
+  int pos = 0;
+  bool equal = true;
+  ForEachPiece(s, [&](const unsigned char *piece, int length) {
+    while (length > 0) {
+      const int m = std::min(length, pieces[i].second - pos);
+      if (memcmp(piece, pieces[i].first + pos, m) != 0) {
+        equal = false;
+        return false;
+      }
+      piece += m;
+      length -= m;
+      pos += m;
+      if (pos == pieces[i].second) {
+        ++i;
+        pos = 0;
+      }
+    }
+    return true;
+  });
+  return equal;
+}
+
+// Literals are interned by the compiler, so equal literals are the same
+// pointer. libc picks the SSE2/AVX2 memcmp for the CPU at load time.
 EXTERNC int string_equal(struct string *s, struct string *t) {
-  int i;
   if (s == t)
     return 1;
-  if (s->length != t->length)
+  if (Length(s) != Length(t))
     return 0;
-  for (i = 0; i < s->length; i++)
-    if (s->chars[i] != t->chars[i])
-      return 0;
-  return 1;
+  if (s->length < 0 || t->length < 0)
+    return RopeEqual(s, t);
+  return memcmp(s->chars, t->chars, s->length) == 0;
+}
+
+// Output of print and printi, handed to stdout when it fills, on flush()
+// and at exit. TIGER_UNBUFFERED=1 writes every call through instead, for
+// interactive programs.
+static char output[1 << 16];
+static size_t output_len = 0;
+static bool unbuffered = false;
+
+static void FlushOutput() {
+  if (output_len) {
+    fwrite(output, 1, output_len, stdout);
+    output_len = 0;
+  }
+  fflush(stdout);
+}
+
+static inline void Output(const char *p, size_t n) {
+  if (unbuffered) {
+    fwrite(p, 1, n, stdout);
+    fflush(stdout);
+    return;
+  }
+  if (output_len + n > sizeof(output)) {
+    FlushOutput();
+    if (n > sizeof(output)) {
+      fwrite(p, 1, n, stdout);
+      return;
+    }
+  }
+  memcpy(output + output_len, p, n);
+  output_len += n;
 }
 
 EXTERNC void print(struct string *s) {
-  int i;
-  unsigned char *p = s->chars;
-  for (i = 0; i < s->length; i++, p++)
-    putchar(*p);
+  if (s->length >= 0) {
+    Output(reinterpret_cast<const char *>(s->chars), s->length);
+    return;
+  }
+  ForEachPiece(s, [](const unsigned char *piece, int length) {
+    Output(reinterpret_cast<const char *>(piece), length);
+    return true;
+  });
 }
 
-EXTERNC void printi(int k) { printf("%d", k); }
+EXTERNC void printi(int k) {
+  // digits from the end, k may be INT_MIN
+  char digits[16];
+  char *p = digits + sizeof(digits);
+  unsigned long n = k < 0 ? -(long)k : k;
+  do {
+    *--p = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  if (k < 0)
+    *--p = '-';
+  Output(p, digits + sizeof(digits) - p);
+}
 
-EXTERNC void flush() { fflush(stdout); }
+EXTERNC void flush() { FlushOutput(); }
 
 struct string consts[256];
 struct string empty = {0, ""};
 
+// Pick the heap by TIGER_HEAP: "mark-sweep" (default), "copying" or
+// "generational"
+gc::TigerHeap *NewTigerHeap() {
+  const char *kind = getenv("TIGER_HEAP");
+  if (!kind || strcmp(kind, "mark-sweep") == 0)
+    return new gc::DerivedHeap();
+  if (strcmp(kind, "copying") == 0)
+    return new gc::CopyingHeap();
+  if (strcmp(kind, "generational") == 0)
+    return new gc::GenerationalHeap();
+  fprintf(stderr, "Warning: unknown TIGER_HEAP %s, use mark-sweep\n", kind);
+  return new gc::DerivedHeap();
+}
+
 int main() {
   int i;
   for (i = 0; i < 256; i++) {
     consts[i].length = 1;
     consts[i].chars[0] = i;
   }
-  // Change it to your own implementation after implement heap and delete the
-  // tiger_heap = new gc::TigerHeap();
-  // fprintf(stderr, "initialize\n");
-  tiger_heap = new gc::DerivedHeap();
+  gc::telemetry.Initialize();
+  gc::alloc_profile.Initialize();
+  // registered after the telemetry and the allocation profile so that the
+  // output precedes their reports
+  if (const char *mode = getenv("TIGER_UNBUFFERED"))
+    unbuffered = strcmp(mode, "0") != 0;
+  atexit(FlushOutput);
+  tiger_heap = NewTigerHeap();
   tiger_heap->Initialize(TIGER_HEAP_SIZE);
+  signal(SIGUSR1, RequestHeapDump);
   return tigermain(0 /* static link */);
 }
 
 EXTERNC int ord(struct string *s) {
-  if (s->length == 0)
+  if (Length(s) == 0)
     return -1;
   else
-    return s->chars[0];
+    return CharAt(s, 0);
 }
 
 EXTERNC struct string *chr(int i) {
   if (i < 0 || i >= 256) {
+    FlushOutput();
     printf("chr(%d) out of range\n", i);
     exit(1);
   }
   return consts + i;
 }
 
-EXTERNC int size(struct string *s) { return s->length; }
+EXTERNC int size(struct string *s) { return Length(s); }
 
+// Long substrings share the characters of s
 EXTERNC struct string *substring(struct string *s, int first, int n) {
-  if (first < 0 || first + n > s->length) {
-    printf("substring([%d],%d,%d) out of range\n", s->length, first, n);
+  const int length = Length(s);
+  if (first < 0 || first + n > length) {
+    FlushOutput();
+    printf("substring([%d],%d,%d) out of range\n", length, first, n);
     exit(1);
   }
   if (n == 1)
-    return consts + s->chars[first];
-  {
-    struct string *t = (struct string *)malloc(sizeof(int) + n);
-    int i;
-    t->length = n;
-    for (i = 0; i < n; i++)
-      t->chars[i] = s->chars[first + i];
+    return consts + CharAt(s, first);
+  if (n < ROPE_MIN) {
+    struct string *t = AllocString(n, &s, &s);
+    CopyChars(t->chars, s, first, n);
     return t;
   }
+  if (n == length)
+    return s;
+  if (s->length < 0 && Rope(s)->kind == CONCAT)
+    Flatten(&s);
+  struct string *base = s;
+  long offset = first;
+  if (s->length < 0) {
+    base = Rope(s)->left;
+    offset += Rope(s)->offset;
+  }
+  struct rope *r = AllocRope(SLICE, n, &base, &base);
+  r->left = base;
+  r->offset = offset;
+  return reinterpret_cast<struct string *>(r);
 }
 
+// Long results are concat nodes
 EXTERNC struct string *concat(struct string *a, struct string *b) {
-  if (a->length == 0)
+  const int m = Length(a), k = Length(b), n = m + k;
+  if (m == 0)
     return b;
-  else if (b->length == 0)
+  if (k == 0)
     return a;
-  else {
-    int i, n = a->length + b->length;
-    struct string *t = (struct string *)malloc(sizeof(int) + n);
-    t->length = n;
-    for (i = 0; i < a->length; i++)
-      t->chars[i] = a->chars[i];
-    for (i = 0; i < b->length; i++)
-      t->chars[i + a->length] = b->chars[i];
+  if (n < ROPE_MIN) {
+    struct string *t = AllocString(n, &a, &b);
+    CopyChars(t->chars, a, 0, m);
+    CopyChars(t->chars + m, b, 0, k);
     return t;
   }
+  if (a->length < 0 && Rope(a)->kind == CONCAT &&
+      Length(Rope(a)->right) + k < ROPE_MIN) {
+    // merge a short b into the short right half of a, so that a string
+    // built a character at a time has a node per ROPE_MIN characters
+    const int j = Length(Rope(a)->right);
+    struct string *leaf = AllocString(j + k, &a, &b);
+    CopyChars(leaf->chars, Rope(a)->right, 0, j);
+    CopyChars(leaf->chars + j, b, 0, k);
+    struct rope *r = AllocRope(CONCAT, n, &a, &leaf);
+    r->left = Rope(a)->left;
+    r->right = leaf;
+    return reinterpret_cast<struct string *>(r);
+  }
+  struct rope *r = AllocRope(CONCAT, n, &a, &b);
+  r->left = a;
+  r->right = b;
+  return reinterpret_cast<struct string *>(r);
 }
 
 // int not(int i) { return !i; }
 
+// Input of getchar and readline. A regular file on stdin is mapped as a
+// whole, anything else is read a block at a time into input_block.
+static const unsigned char *input = nullptr;
+static size_t input_pos = 0;
+static size_t input_end = 0;
+static bool input_mapped = false;
+static bool input_ready = false;
+static unsigned char input_block[1 << 16];
+
+static void InitInput() {
+  input_ready = true;
+  input = input_block;
+  struct stat st;
+  if (fstat(0, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return;
+  // the shell may have left stdin anywhere in the file
+  const off_t offset = lseek(0, 0, SEEK_CUR);
+  if (offset < 0 || offset >= st.st_size)
+    return;
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+  if (map == MAP_FAILED)
+    return;
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  input = static_cast<const unsigned char *>(map);
+  input_pos = offset;
+  input_end = st.st_size;
+  input_mapped = true;
+}
+
+// Refill the input once input_pos reaches input_end
+// @return false at the end of the input
+static bool FillInput() {
+  if (!input_ready) {
+    InitInput();
+    if (input_pos < input_end)
+      return true;
+  }
+  if (input_mapped)
+    return false;
+  // a prompt has to be out before we wait for the answer
+  FlushOutput();
+  ssize_t n;
+  do {
+    n = read(0, input_block, sizeof(input_block));
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0)
+    return false;
+  input_pos = 0;
+  input_end = n;
+  return true;
+}
+
 #undef getchar
 
 EXTERNC struct string *__wrap_getchar() {
-  int i = getc(stdin);
-  if (i == EOF)
+  if (input_pos >= input_end && !FillInput())
     return &empty;
-  else
-    return consts + i;
+  return consts + input[input_pos++];
+}
+
+// The next line including its newline, the empty string at the end of the
+// input
+EXTERNC struct string *readline() {
+  if (input_pos >= input_end && !FillInput())
+    return &empty;
+  const unsigned char *start = input + input_pos;
+  auto *newline = static_cast<const unsigned char *>(
+      memchr(start, '\n', input_end - input_pos));
+  struct string *none = nullptr;
+  if (newline) {
+    // the common case, the line is in the buffer
+    const int n = newline + 1 - start;
+    input_pos += n;
+    if (n == 1)
+      return consts + '\n';
+    struct string *t = AllocString(n, &none, &none);
+    memcpy(t->chars, start, n);
+    return t;
+  }
+  // the line goes on past the buffer
+  std::string line(reinterpret_cast<const char *>(start),
+                   input_end - input_pos);
+  input_pos = input_end;
+  while (FillInput()) {
+    start = input + input_pos;
+    newline = static_cast<const unsigned char *>(
+        memchr(start, '\n', input_end - input_pos));
+    const size_t n = newline ? newline + 1 - start : input_end - input_pos;
+    line.append(reinterpret_cast<const char *>(start), n);
+    input_pos += n;
+    if (newline)
+      break;
+  }
+  struct string *t = AllocString(line.size(), &none, &none);
+  memcpy(t->chars, line.data(), line.size());
+  return t;
 }
@@ -1,11 +1,16 @@
 #include "tiger/translate/translate.h"
 #include "tiger/frame/frame.h"
 #include "tiger/runtime/gc/roots/roots.h"
+
+#include <unordered_map>
+
 extern frame::Frags *frags;
 extern frame::RegManager *reg_manager;
 
 namespace tr {
 
+bool alloc_profile = false;
+
 Access *Access::AllocLocal(Level *level, bool escape, bool in_heap) {
   auto access = level->frame_->AllocLocal(escape, in_heap, level->frame_);
   return new Access(level, access);
@@ -127,7 +132,133 @@ namespace absyn {
 inline bool IsPointerType(type::Ty *type) {
   auto ty = type->ActualTy();
   return typeid(*ty) == typeid(type::RecordTy) ||
-         typeid(*ty) == typeid(type::ArrayTy);
+         typeid(*ty) == typeid(type::ArrayTy) ||
+         typeid(*ty) == typeid(type::StringTy);
+}
+
+/**
+ * Store a pointer into a heap object and mark the card of the stored-to
+ * address, so that a generational heap can find old-to-young pointers.
+ * The card table itself is gc::CardTable in the runtime.
+ */
+tree::Stm *StorePointer(tree::Exp *address, tree::Exp *value) {
+  const auto addr = temp::TempFactory::NewTemp();
+  const auto mask = new tree::MemExp(
+      new tree::NameExp(temp::LabelFactory::NamedLabel(gc::CARD_MASK)));
+  // card index scaled to a word offset
+  const auto card = new tree::BinopExp(
+      tree::LSHIFT_OP,
+      new tree::BinopExp(
+          tree::AND_OP,
+          new tree::BinopExp(tree::RSHIFT_OP, new tree::TempExp(addr),
+                             new tree::ConstExp(gc::CARD_SHIFT)),
+          mask),
+      new tree::ConstExp(3));
+  const auto table = new tree::MemExp(
+      new tree::NameExp(temp::LabelFactory::NamedLabel(gc::CARD_TABLE)));
+  const auto barrier = new tree::MoveStm(
+      new tree::MemExp(new tree::BinopExp(tree::PLUS_OP, table, card)),
+      new tree::ConstExp(1));
+  return new tree::SeqStm(
+      new tree::MoveStm(new tree::TempExp(addr), address),
+      new tree::SeqStm(
+          new tree::MoveStm(new tree::MemExp(new tree::TempExp(addr)), value),
+          barrier));
+}
+
+/**
+ * Bump-allocate a record from tiger_heap_top when it fits before
+ * tiger_heap_limit, and fall back to the alloc_record call otherwise:
+ *
+ *   top := tiger_heap_top; end := top + header + fields
+ *   if end > tiger_heap_limit goto slow
+ *   tiger_heap_top := end; MEM[top] := header; reg := top + header
+ *   pointer fields := nil; goto done
+ * slow:
+ *   call
+ * done:
+ *
+ * Pointer fields are cleared because initialising the later fields may
+ * collect before they are stored.
+ */
+tree::Stm *InlineAllocRecord(temp::Temp *reg, type::RecordTy *record_ty,
+                             temp::Label *descriptor, tree::Stm *call) {
+  const auto &fields = record_ty->fields_->GetList();
+  const int words = std::max(static_cast<int>(fields.size()), 1);
+  const int total = gc::HEADER_SIZE + words * reg_manager->WordSize();
+  if (total > gc::INLINE_ALLOC_MAX)
+    return call;
+
+  const auto top = temp::TempFactory::NewTemp();
+  const auto end = temp::TempFactory::NewTemp();
+  const auto fast = temp::LabelFactory::NewLabel();
+  const auto slow = temp::LabelFactory::NewLabel();
+  const auto done = temp::LabelFactory::NewLabel();
+  const auto heap_top = [] {
+    return new tree::MemExp(
+        new tree::NameExp(temp::LabelFactory::NamedLabel(gc::HEAP_TOP)));
+  };
+  // the runtime sees the bitmap, which starts after the field count
+  const auto header = new tree::BinopExp(
+      tree::PLUS_OP,
+      new tree::BinopExp(
+          tree::LSHIFT_OP,
+          new tree::BinopExp(tree::PLUS_OP, new tree::NameExp(descriptor),
+                             new tree::ConstExp(reg_manager->WordSize())),
+          new tree::ConstExp(gc::DESCRIPTOR_SHIFT)),
+      new tree::ConstExp(words << gc::FIELD_COUNT_SHIFT));
+
+  tree::Stm *stm = new tree::SeqStm(
+      new tree::MoveStm(new tree::TempExp(top), heap_top()),
+      new tree::SeqStm(
+          new tree::MoveStm(new tree::TempExp(end),
+                            new tree::BinopExp(tree::PLUS_OP,
+                                               new tree::TempExp(top),
+                                               new tree::ConstExp(total))),
+          new tree::CjumpStm(
+              tree::GT_OP, new tree::TempExp(end),
+              new tree::MemExp(new tree::NameExp(
+                  temp::LabelFactory::NamedLabel(gc::HEAP_LIMIT))),
+              slow, fast)));
+  stm = new tree::SeqStm(stm, new tree::LabelStm(fast));
+  stm = new tree::SeqStm(
+      stm, new tree::MoveStm(heap_top(), new tree::TempExp(end)));
+  stm = new tree::SeqStm(
+      stm, new tree::MoveStm(new tree::MemExp(new tree::TempExp(top)), header));
+  stm = new tree::SeqStm(
+      stm, new tree::MoveStm(new tree::TempExp(reg),
+                             new tree::BinopExp(
+                                 tree::PLUS_OP, new tree::TempExp(top),
+                                 new tree::ConstExp(gc::HEADER_SIZE))));
+  int i = 0;
+  for (const auto &field : fields) {
+    if (IsPointerType(field->ty_)) {
+      stm = new tree::SeqStm(
+          stm, new tree::MoveStm(
+                   new tree::MemExp(new tree::BinopExp(
+                       tree::PLUS_OP, new tree::TempExp(reg),
+                       new tree::ConstExp(i * reg_manager->WordSize()))),
+                   new tree::ConstExp(0)));
+    }
+    i++;
+  }
+  stm = new tree::SeqStm(
+      stm, new tree::JumpStm(new tree::NameExp(done),
+                             new std::vector<temp::Label *>{done}));
+  stm = new tree::SeqStm(stm, new tree::LabelStm(slow));
+  stm = new tree::SeqStm(stm, call);
+  return new tree::SeqStm(stm, new tree::LabelStm(done));
+}
+
+/**
+ * String naming an allocation site for the profiling runtime, as
+ * "file:line.column type".
+ */
+tree::Exp *AllocSite(int pos, sym::Symbol *type, err::ErrorMsg *errormsg) {
+  const auto label = temp::LabelFactory::NewLabel();
+  frags->PushBack(new frame::StringFrag(
+      label, errormsg->Position(pos) + " " + type->Name()));
+  return new tree::NameExp(label);
 }
 #endif
 
@@ -238,8 +369,14 @@ tr::ExpAndTy *IntExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
 tr::ExpAndTy *StringExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
                                    tr::Level *level, temp::Label *label,
                                    err::ErrorMsg *errormsg) const {
-  auto str_label = temp::LabelFactory::NewLabel();
-  frags->PushBack(new frame::StringFrag(str_label, str_));
+  // strings are immutable, equal literals share one fragment and then
+  // compare equal by pointer in string_equal
+  static std::unordered_map<std::string, temp::Label *> literals;
+  auto &str_label = literals[str_];
+  if (!str_label) {
+    str_label = temp::LabelFactory::NewLabel();
+    frags->PushBack(new frame::StringFrag(str_label, str_));
+  }
   return new tr::ExpAndTy(new tr::ExExp(new tree::NameExp(str_label)),
                           type::StringTy::Instance());
 }
@@ -386,13 +523,24 @@ tr::ExpAndTy *RecordExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
   auto reg = temp::TempFactory::NewTemp();
   args->Insert(new tree::ConstExp(size * reg_manager->WordSize()));
 #ifdef GC_ENABLED
-  args->Append(new tree::NameExp(
-      temp::LabelFactory::NamedLabel(typ_->Name() + "_DESCRIPTOR")));
+  const auto descriptor =
+      temp::LabelFactory::NamedLabel(typ_->Name() + "_DESCRIPTOR");
+  args->Append(new tree::NameExp(descriptor));
+  std::string alloc_record = "alloc_record";
+  if (tr::alloc_profile) {
+    alloc_record = "alloc_record_site";
+    args->Append(AllocSite(pos_, typ_, errormsg));
+  }
   tree::Stm *stm = new tree::MoveStm(
       new tree::TempExp(reg),
       new tree::CallExp(
-          new tree::NameExp(temp::LabelFactory::NamedLabel("alloc_record")),
+          new tree::NameExp(temp::LabelFactory::NamedLabel(alloc_record)),
           args));
+  // the profile has to see every allocation
+  if (!tr::alloc_profile) {
+    stm = InlineAllocRecord(reg, dynamic_cast<type::RecordTy *>(type),
+                            descriptor, stm);
+  }
 #else
   tree::Stm *stm = new tree::MoveStm(
       new tree::TempExp(reg),
@@ -411,8 +559,13 @@ tr::ExpAndTy *RecordExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
                            new tree::ConstExp(i * reg_manager->WordSize())));
     auto field_exp = field_iter.operator*()->exp_->Translate(venv, tenv, level,
                                                              label, errormsg);
-    stm = new tree::SeqStm(stm,
-                           new tree::MoveStm(mem_exp, field_exp->exp_->UnEx()));
+    tree::Stm *field_stm = new tree::MoveStm(mem_exp, field_exp->exp_->UnEx());
+#ifdef GC_ENABLED
+    if (IsPointerType(field_exp->ty_)) {
+      field_stm = StorePointer(mem_exp->exp_, field_exp->exp_->UnEx());
+    }
+#endif
+    stm = new tree::SeqStm(stm, field_stm);
     field_iter++;
     i++;
   }
@@ -455,6 +608,15 @@ tr::ExpAndTy *AssignExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
       return new tr::ExpAndTy(nullptr, type::VoidTy::Instance());
     }
   }
+#ifdef GC_ENABLED
+  if (typeid(*var_) != typeid(SimpleVar) && IsPointerType(src_exp->ty_)) {
+    // record field or array element, the store needs the write barrier
+    const auto dst = dynamic_cast<tree::MemExp *>(var_exp->exp_->UnEx());
+    return new tr::ExpAndTy(
+        new tr::NxExp(StorePointer(dst->exp_, src_exp->exp_->UnEx())),
+        type::VoidTy::Instance());
+  }
+#endif
   return new tr::ExpAndTy(new tr::NxExp(new tree::MoveStm(
                               var_exp->exp_->UnEx(), src_exp->exp_->UnEx())),
                           type::VoidTy::Instance());
@@ -628,8 +790,19 @@ tr::ExpAndTy *ArrayExp::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
   //  exp_list->Append(new tree::TempExp(reg_manager->FramePointer()));
   exp_list->Append(size_exp->exp_->UnEx());
   exp_list->Append(init_exp->exp_->UnEx());
+  std::string init_array = "init_array";
+#ifdef GC_ENABLED
+  // the collector only traces the elements of pointer arrays
+  if (IsPointerType(dynamic_cast<type::ArrayTy *>(type)->ty_)) {
+    init_array = "init_pointer_array";
+  }
+  if (tr::alloc_profile) {
+    init_array += "_site";
+    exp_list->Append(AllocSite(pos_, typ_, errormsg));
+  }
+#endif
   const auto exp = new tree::CallExp(
-      new tree::NameExp(temp::LabelFactory::NamedLabel("init_array")),
+      new tree::NameExp(temp::LabelFactory::NamedLabel(init_array)),
       exp_list);
   return new tr::ExpAndTy(new tr::ExExp(exp), type);
 }
@@ -752,16 +925,19 @@ tr::Exp *TypeDec::Translate(env::VEnvPtr venv, env::TEnvPtr tenv,
       const auto record_ty = dynamic_cast<type::RecordTy *>(name_type->ty_);
 
       auto des_label = name_type->sym_->Name() + "_DESCRIPTOR";
-      std::string des_fields;
-      for (const auto &field : record_ty->fields_->GetList()) {
+      const auto &fields = record_ty->fields_->GetList();
+      std::vector<uint64_t> bitmap(
+          std::max<size_t>((fields.size() + 63) / 64, 1));
+      uint64_t i = 0;
+      for (const auto &field : fields) {
         if (IsPointerType(field->ty_->ActualTy())) {
-          des_fields += "1";
-        } else {
-          des_fields += "0";
+          bitmap[i / 64] |= 1ull << (i % 64);
         }
+        i++;
       }
-      frags->PushBack(new frame::StringFrag(
-          temp::LabelFactory::NamedLabel(des_label), des_fields));
+      frags->PushBack(new frame::DescriptorFrag(
+          temp::LabelFactory::NamedLabel(des_label), fields.size(), bitmap,
+          name_type->sym_->Name()));
     }
   }
 #endif
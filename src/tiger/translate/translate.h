@@ -66,6 +66,13 @@ public:
                          std::list<bool> *in_heap = nullptr);
 };
 
+/**
+ * Set by --alloc-profile. Records and arrays are then allocated by the
+ * *_site runtime functions, which also get a string naming the source
+ * position and the type of the allocation.
+ */
+extern bool alloc_profile;
+
 class ProgTr {
 public:
   // TODO: Put your lab5 code here */